@@ -0,0 +1,785 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+// an axis aligned bounding box, empty (min above max) until something is
+// added to it
+struct Aabb {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	static Aabb fromSphere(const glm::vec3& center, float radius) {
+		Aabb box;
+		box.min = center - glm::vec3(radius);
+		box.max = center + glm::vec3(radius);
+
+		return box;
+	}
+
+	void grow(const Aabb& other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	void grow(const glm::vec3& point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	glm::vec3 getCenter() const {
+		return (min + max) * 0.5f;
+	}
+
+	// half of it really, which doesn't matter for comparing costs
+	float getSurfaceArea() const {
+		glm::vec3 size = max - min;
+
+		if (size.x < 0.0f) {
+			return 0.0f;
+		}
+
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	bool operator==(const Aabb& other) const {
+		return min == other.min && max == other.max;
+	}
+
+	bool operator!=(const Aabb& other) const {
+		return !(*this == other);
+	}
+};
+
+// 32 bytes, so two nodes share a cache line
+struct BvhNode {
+	Aabb bounds;
+	// an interior node's left child, with the right child right after it, or a
+	// leaf's first entry in the item order
+	uint32_t firstChildOrItem = 0;
+	uint32_t itemCount = 0; // 0 for interior nodes
+};
+
+struct BvhRayHit {
+	uint32_t item;
+	float distance; // along the ray, in multiples of its direction
+};
+
+// A bounding volume hierarchy over boxes, for answering spatial queries
+// (frustum culling, ray picking, finding what's nearby) without testing every
+// item.  Items are whatever the caller numbers 0 to n - 1, usually renderable
+// ids.
+//
+// Nodes are split with the surface area heuristic, estimated from a handful
+// of bins along each axis rather than by sorting.  The top of the tree is
+// split with the binning spread across a worker pool, until the nodes are
+// small enough that building each one's whole subtree is a task of its own.
+//
+// When items move, updateItem() refits just the nodes above them, and
+// refit() redoes every node, which is cheaper once most items have moved.
+// Neither changes the tree's shape, so after a lot of movement queries slow
+// down, and it's worth building again, which Scene::updateBvh() does after
+// enough moves.
+struct Bvh {
+	static constexpr uint32_t kBinCount = 16;
+	// nodes with more items than this are always split
+	static constexpr uint32_t kMaxLeafSize = 4;
+	// the cost of visiting a node, relative to testing one item, which is what
+	// keeps small nodes from being split all the way down to single items
+	static constexpr float kTraversalCost = 1.0f;
+	// nodes with at most this many items are built on a single thread
+	static constexpr uint32_t kSubtreeTaskSize = 4096;
+
+	// workerPool can be null, to build on the calling thread
+	void build(const std::vector<Aabb>& itemBounds, WorkerPool* workerPool) {
+		uint32_t itemCount = static_cast<uint32_t>(itemBounds.size());
+
+		itemBounds_ = itemBounds;
+		itemOrder_.resize(itemCount);
+		buildItems_.resize(itemCount);
+
+		for (uint32_t item = 0; item < itemCount; item++) {
+			buildItems_[item] = { itemBounds[item], itemBounds[item].getCenter(), item };
+		}
+
+		nodes_.clear();
+		nodes_.reserve(std::max(1u, itemCount * 2));
+		nodes_.emplace_back();
+
+		if (itemCount == 0) {
+			parents_.assign(1, kNoParent);
+			itemLeaves_.clear();
+			buildItems_ = {};
+			return;
+		}
+
+		// split the top of the tree here, with the binning in parallel, and set
+		// aside nodes that are small enough to be built as a whole
+		std::vector<PendingNode> pending = { { 0, 0, itemCount } };
+		std::vector<PendingNode> subtrees;
+		Bins bins;
+
+		while (!pending.empty()) {
+			PendingNode node = pending.back();
+			pending.pop_back();
+
+			if (node.itemCount <= kSubtreeTaskSize) {
+				subtrees.push_back(node);
+				continue;
+			}
+
+			this->splitNode(nodes_, node, workerPool, pending, bins);
+		}
+
+		// every subtree builds into its own nodes, since they're all appending,
+		// and they're merged in after
+		std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size());
+
+		runTasks(workerPool, static_cast<uint32_t>(subtrees.size()), [&](uint32_t i) {
+			std::vector<BvhNode>& nodes = subtreeNodes[i];
+			nodes.emplace_back();
+
+			std::vector<PendingNode> subtreePending = {
+				{ 0, subtrees[i].firstItem, subtrees[i].itemCount }
+			};
+			Bins subtreeBins;
+
+			while (!subtreePending.empty()) {
+				PendingNode node = subtreePending.back();
+				subtreePending.pop_back();
+
+				this->splitNode(nodes, node, nullptr, subtreePending, subtreeBins);
+			}
+		});
+
+		for (size_t i = 0; i < subtrees.size(); i++) {
+			const std::vector<BvhNode>& nodes = subtreeNodes[i];
+
+			// the subtree's root replaces its placeholder, and the rest go on the
+			// end, which moves every child index by the same amount
+			uint32_t offset = static_cast<uint32_t>(nodes_.size()) - 1;
+
+			for (size_t j = 0; j < nodes.size(); j++) {
+				BvhNode node = nodes[j];
+
+				if (node.itemCount == 0) {
+					node.firstChildOrItem += offset;
+				}
+
+				if (j == 0) {
+					nodes_[subtrees[i].node] = node;
+				} else {
+					nodes_.push_back(node);
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < itemCount; i++) {
+			itemOrder_[i] = buildItems_[i].item;
+		}
+
+		buildItems_ = {};
+
+		this->linkParents();
+	}
+
+	// call when an item moves, or otherwise changes size
+	// refits the nodes above it, stopping as soon as one doesn't change
+	void updateItem(uint32_t item, const Aabb& bounds) {
+		itemBounds_[item] = bounds;
+
+		for (uint32_t node = itemLeaves_[item]; node != kNoParent; node = parents_[node]) {
+			Aabb nodeBounds = this->computeNodeBounds(node);
+
+			if (nodeBounds == nodes_[node].bounds) {
+				break;
+			}
+
+			nodes_[node].bounds = nodeBounds;
+		}
+	}
+
+	// refits every node to new bounds for every item
+	void refit(const std::vector<Aabb>& itemBounds) {
+		itemBounds_ = itemBounds;
+
+		// children always come after their parents, so going backwards visits
+		// them first
+		for (size_t node = nodes_.size(); node-- > 0;) {
+			nodes_[node].bounds = this->computeNodeBounds(static_cast<uint32_t>(node));
+		}
+	}
+
+	uint32_t getItemCount() const {
+		return static_cast<uint32_t>(itemBounds_.size());
+	}
+
+	size_t getNodeCount() const {
+		return nodes_.size();
+	}
+
+	// appends every item whose bounds are at least partly inside the frustum
+	// once a node is entirely inside a plane, nothing below it is tested
+	// against that plane again, and nodes entirely inside all of them have
+	// their items added without any tests
+	void cullFrustum(const Frustum& frustum, std::vector<uint32_t>& visibleItems) const {
+		if (itemBounds_.empty()) {
+			return;
+		}
+
+		const uint32_t kAllPlanes = (1 << Frustum::kPlaneCount) - 1;
+
+		struct Entry {
+			uint32_t node;
+			uint32_t planeMask; // planes the node isn't known to be inside of
+		};
+
+		std::vector<Entry> stack;
+		stack.reserve(64);
+		stack.push_back({ 0, kAllPlanes });
+
+		while (!stack.empty()) {
+			Entry entry = stack.back();
+			stack.pop_back();
+
+			const BvhNode& node = nodes_[entry.node];
+			uint32_t planeMask = entry.planeMask;
+
+			if (!classifyBox(frustum, node.bounds, planeMask)) {
+				continue;
+			}
+
+			if (planeMask == 0) {
+				this->appendItems(entry.node, visibleItems);
+				continue;
+			}
+
+			if (node.itemCount == 0) {
+				stack.push_back({ node.firstChildOrItem, planeMask });
+				stack.push_back({ node.firstChildOrItem + 1, planeMask });
+				continue;
+			}
+
+			for (uint32_t i = 0; i < node.itemCount; i++) {
+				uint32_t item = itemOrder_[node.firstChildOrItem + i];
+				uint32_t itemPlaneMask = planeMask;
+
+				if (classifyBox(frustum, itemBounds_[item], itemPlaneMask)) {
+					visibleItems.push_back(item);
+				}
+			}
+		}
+	}
+
+	// the nearest item whose bounds the ray hits within maxDistance, if any
+	// an origin inside an item's bounds hits it at distance 0
+	std::optional<BvhRayHit> raycast(
+			const glm::vec3& origin,
+			const glm::vec3& direction,
+			float maxDistance = FLT_MAX) const {
+		if (itemBounds_.empty()) {
+			return std::nullopt;
+		}
+
+		glm::vec3 inverseDirection(
+				1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+		std::optional<BvhRayHit> nearest;
+
+		if (!intersectRay(origin, inverseDirection, nodes_[0].bounds, maxDistance)) {
+			return nearest;
+		}
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty()) {
+			const BvhNode& node = nodes_[stack.back()];
+			stack.pop_back();
+
+			// hits are only looked for nearer than the nearest so far
+			float distance;
+
+			if (!intersectRay(origin, inverseDirection, node.bounds, maxDistance, &distance)) {
+				continue;
+			}
+
+			if (node.itemCount > 0) {
+				for (uint32_t i = 0; i < node.itemCount; i++) {
+					uint32_t item = itemOrder_[node.firstChildOrItem + i];
+
+					if (intersectRay(origin, inverseDirection, itemBounds_[item], maxDistance, &distance)) {
+						maxDistance = distance;
+						nearest = BvhRayHit{ item, distance };
+					}
+				}
+
+				continue;
+			}
+
+			// visit the nearer child first, so farther ones can be skipped
+			uint32_t left = node.firstChildOrItem;
+			uint32_t right = left + 1;
+			float leftDistance = FLT_MAX;
+			float rightDistance = FLT_MAX;
+			bool hitLeft = intersectRay(
+					origin, inverseDirection, nodes_[left].bounds, maxDistance, &leftDistance);
+			bool hitRight = intersectRay(
+					origin, inverseDirection, nodes_[right].bounds, maxDistance, &rightDistance);
+
+			if (leftDistance > rightDistance) {
+				std::swap(left, right);
+				std::swap(hitLeft, hitRight);
+			}
+
+			if (hitRight) {
+				stack.push_back(right);
+			}
+
+			if (hitLeft) {
+				stack.push_back(left);
+			}
+		}
+
+		return nearest;
+	}
+
+	// appends every item whose bounds touch the sphere
+	void findItemsInSphere(
+			const glm::vec3& center,
+			float radius,
+			std::vector<uint32_t>& items) const {
+		if (itemBounds_.empty()) {
+			return;
+		}
+
+		float radiusSquared = radius * radius;
+
+		std::vector<uint32_t> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty()) {
+			const BvhNode& node = nodes_[stack.back()];
+			stack.pop_back();
+
+			if (getDistanceSquared(node.bounds, center) > radiusSquared) {
+				continue;
+			}
+
+			if (node.itemCount == 0) {
+				stack.push_back(node.firstChildOrItem);
+				stack.push_back(node.firstChildOrItem + 1);
+				continue;
+			}
+
+			for (uint32_t i = 0; i < node.itemCount; i++) {
+				uint32_t item = itemOrder_[node.firstChildOrItem + i];
+
+				if (getDistanceSquared(itemBounds_[item], center) <= radiusSquared) {
+					items.push_back(item);
+				}
+			}
+		}
+	}
+
+ private:
+	static constexpr uint32_t kNoParent = UINT32_MAX;
+
+	// a node whose items have been gathered, but that hasn't been split yet
+	struct PendingNode {
+		uint32_t node;
+		uint32_t firstItem; // in itemOrder_
+		uint32_t itemCount;
+	};
+
+	// an item's copy of everything building looks at, so nodes are split by
+	// moving these around rather than indices into the item arrays, which keeps
+	// each node's items together in memory
+	struct BuildItem {
+		Aabb bounds;
+		glm::vec3 center;
+		uint32_t item;
+	};
+
+	// what falls into each bin along each axis
+	// small nodes only use their first few bins, so only those are touched
+	struct Bins {
+		std::array<std::array<Aabb, kBinCount>, 3> bounds;
+		std::array<std::array<uint32_t, kBinCount>, 3> counts{};
+
+		void reset(uint32_t binCount) {
+			for (int axis = 0; axis < 3; axis++) {
+				std::fill_n(bounds[axis].begin(), binCount, Aabb{});
+				std::fill_n(counts[axis].begin(), binCount, 0);
+			}
+		}
+
+		void add(const Bins& other, uint32_t binCount) {
+			for (int axis = 0; axis < 3; axis++) {
+				for (uint32_t bin = 0; bin < binCount; bin++) {
+					bounds[axis][bin].grow(other.bounds[axis][bin]);
+					counts[axis][bin] += other.counts[axis][bin];
+				}
+			}
+		}
+	};
+
+	std::vector<BvhNode> nodes_; // the root is nodes_[0]
+	std::vector<uint32_t> parents_; // indexed like nodes_
+	std::vector<Aabb> itemBounds_; // indexed by item
+	std::vector<uint32_t> itemLeaves_; // indexed by item
+	// items, in the order the leaves refer to them, so every leaf's items are
+	// contiguous, and so are every subtree's
+	std::vector<uint32_t> itemOrder_;
+	std::vector<BuildItem> buildItems_; // in the item order, only while building
+
+	// per chunk, for splitting big nodes in parallel
+	std::vector<Aabb> chunkBounds_;
+	std::vector<Aabb> chunkCenterBounds_;
+	std::vector<Bins> chunkBins_;
+
+	// runs task(i) for i from 0 to taskCount - 1, on the pool if there is one
+	template <typename Task>
+	static void runTasks(WorkerPool* workerPool, uint32_t taskCount, const Task& task) {
+		if (workerPool != nullptr) {
+			workerPool->run(taskCount, task);
+			return;
+		}
+
+		for (uint32_t i = 0; i < taskCount; i++) {
+			task(i);
+		}
+	}
+
+	// fills in the pending node, as a leaf, or as an interior node with two new
+	// children, which are added to pending
+	// big nodes split their items into chunks across the pool
+	// bins is scratch memory, one per thread that's building
+	void splitNode(
+			std::vector<BvhNode>& nodes,
+			const PendingNode& pendingNode,
+			WorkerPool* workerPool,
+			std::vector<PendingNode>& pending,
+			Bins& bins) {
+		uint32_t firstItem = pendingNode.firstItem;
+		uint32_t itemCount = pendingNode.itemCount;
+
+		uint32_t chunkCount = 1;
+
+		if (workerPool != nullptr) {
+			chunkCount = std::max(
+					1u, std::min(workerPool->getThreadCount(), itemCount / kSubtreeTaskSize));
+		}
+
+		uint32_t chunkSize = (itemCount + chunkCount - 1) / chunkCount;
+
+		auto getChunkRange = [&](uint32_t chunk) {
+			return std::make_pair(
+					firstItem + std::min(itemCount, chunk * chunkSize),
+					firstItem + std::min(itemCount, (chunk + 1) * chunkSize));
+		};
+
+		// the node's bounds, and the bounds of its items' centers, which are what
+		// gets binned
+		Aabb bounds;
+		Aabb centerBounds;
+
+		auto boundItems = [&](uint32_t chunk, Aabb& chunkBounds, Aabb& chunkCenterBounds) {
+			auto [begin, end] = getChunkRange(chunk);
+
+			for (uint32_t i = begin; i < end; i++) {
+				chunkBounds.grow(buildItems_[i].bounds);
+				chunkCenterBounds.grow(buildItems_[i].center);
+			}
+		};
+
+		// the parallel path only runs at the top of the tree, on the thread
+		// calling build(), so it can share scratch memory between nodes, while
+		// subtrees stay off the heap entirely
+		if (chunkCount == 1) {
+			boundItems(0, bounds, centerBounds);
+		} else {
+			chunkBounds_.assign(chunkCount, Aabb{});
+			chunkCenterBounds_.assign(chunkCount, Aabb{});
+
+			runTasks(workerPool, chunkCount, [&](uint32_t chunk) {
+				boundItems(chunk, chunkBounds_[chunk], chunkCenterBounds_[chunk]);
+			});
+
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+				bounds.grow(chunkBounds_[chunk]);
+				centerBounds.grow(chunkCenterBounds_[chunk]);
+			}
+		}
+
+		nodes[pendingNode.node].bounds = bounds;
+
+		if (itemCount == 1) {
+			this->makeLeaf(nodes[pendingNode.node], pendingNode);
+			return;
+		}
+
+		// more bins than items can't find any better splits
+		uint32_t binCount = std::min(kBinCount, itemCount);
+		float binCountFloat = static_cast<float>(binCount);
+
+		glm::vec3 centerExtent = centerBounds.max - centerBounds.min;
+		glm::vec3 binScale(
+				centerExtent.x > 0.0f ? binCountFloat / centerExtent.x : 0.0f,
+				centerExtent.y > 0.0f ? binCountFloat / centerExtent.y : 0.0f,
+				centerExtent.z > 0.0f ? binCountFloat / centerExtent.z : 0.0f);
+
+		auto getBin = [&](const glm::vec3& center, int axis) {
+			float position = (center[axis] - centerBounds.min[axis]) * binScale[axis];
+
+			return std::min(binCount - 1, static_cast<uint32_t>(position));
+		};
+
+		bins.reset(binCount);
+
+		auto binItems = [&](uint32_t chunk, Bins& chunkBins) {
+			auto [begin, end] = getChunkRange(chunk);
+
+			for (uint32_t i = begin; i < end; i++) {
+				const BuildItem& item = buildItems_[i];
+
+				for (int axis = 0; axis < 3; axis++) {
+					uint32_t bin = getBin(item.center, axis);
+					chunkBins.bounds[axis][bin].grow(item.bounds);
+					chunkBins.counts[axis][bin]++;
+				}
+			}
+		};
+
+		if (chunkCount == 1) {
+			binItems(0, bins);
+		} else {
+			chunkBins_.resize(chunkCount);
+
+			runTasks(workerPool, chunkCount, [&](uint32_t chunk) {
+				chunkBins_[chunk].reset(binCount);
+				binItems(chunk, chunkBins_[chunk]);
+			});
+
+			for (const Bins& chunkBins : chunkBins_) {
+				bins.add(chunkBins, binCount);
+			}
+		}
+
+		// the split between bins with the lowest cost, which is each side's
+		// surface area times its item count, swept from both ends
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		uint32_t bestSplit = 0; // the first bin on the right
+
+		for (int axis = 0; axis < 3; axis++) {
+			if (binScale[axis] == 0.0f) {
+				continue;
+			}
+
+			std::array<float, kBinCount> leftCosts;
+			Aabb leftBounds;
+			uint32_t leftCount = 0;
+
+			for (uint32_t bin = 0; bin < binCount - 1; bin++) {
+				leftBounds.grow(bins.bounds[axis][bin]);
+				leftCount += bins.counts[axis][bin];
+				leftCosts[bin] = leftCount * leftBounds.getSurfaceArea();
+			}
+
+			Aabb rightBounds;
+			uint32_t rightCount = 0;
+
+			for (uint32_t bin = binCount - 1; bin > 0; bin--) {
+				rightBounds.grow(bins.bounds[axis][bin]);
+				rightCount += bins.counts[axis][bin];
+
+				// both sides need something in them
+				if (rightCount == 0 || rightCount == itemCount) {
+					continue;
+				}
+
+				float cost = leftCosts[bin - 1] + rightCount * rightBounds.getSurfaceArea();
+
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = bin;
+				}
+			}
+		}
+
+		// costs are relative to this node's surface area, so visiting it costs its
+		// area times kTraversalCost
+		float leafCost = itemCount * bounds.getSurfaceArea();
+		bestCost += kTraversalCost * bounds.getSurfaceArea();
+
+		if (itemCount <= kMaxLeafSize && (bestAxis < 0 || bestCost >= leafCost)) {
+			this->makeLeaf(nodes[pendingNode.node], pendingNode);
+			return;
+		}
+
+		BuildItem* items = buildItems_.data() + firstItem;
+		uint32_t leftCount;
+
+		if (bestAxis >= 0) {
+			leftCount = static_cast<uint32_t>(
+					std::partition(items, items + itemCount, [&](const BuildItem& item) {
+						return getBin(item.center, bestAxis) < bestSplit;
+					}) - items);
+		} else {
+			// every center is in the same place, so there's nothing to go on, but
+			// leaves still have to be small
+			leftCount = itemCount / 2;
+		}
+
+		uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+		nodes[pendingNode.node].firstChildOrItem = leftChild;
+		nodes[pendingNode.node].itemCount = 0;
+		nodes.emplace_back();
+		nodes.emplace_back();
+
+		pending.push_back({ leftChild, firstItem, leftCount });
+		pending.push_back({ leftChild + 1, firstItem + leftCount, itemCount - leftCount });
+	}
+
+	void makeLeaf(BvhNode& node, const PendingNode& pendingNode) {
+		node.firstChildOrItem = pendingNode.firstItem;
+		node.itemCount = pendingNode.itemCount;
+	}
+
+	// parents and item leaves, for updateItem()
+	void linkParents() {
+		parents_.assign(nodes_.size(), kNoParent);
+		itemLeaves_.resize(itemBounds_.size());
+
+		for (uint32_t i = 0; i < nodes_.size(); i++) {
+			const BvhNode& node = nodes_[i];
+
+			if (node.itemCount == 0) {
+				parents_[node.firstChildOrItem] = i;
+				parents_[node.firstChildOrItem + 1] = i;
+				continue;
+			}
+
+			for (uint32_t j = 0; j < node.itemCount; j++) {
+				itemLeaves_[itemOrder_[node.firstChildOrItem + j]] = i;
+			}
+		}
+	}
+
+	// from the node's children, or its items for a leaf
+	Aabb computeNodeBounds(uint32_t nodeIndex) const {
+		const BvhNode& node = nodes_[nodeIndex];
+		Aabb bounds;
+
+		if (node.itemCount == 0) {
+			if (!itemBounds_.empty()) {
+				bounds.grow(nodes_[node.firstChildOrItem].bounds);
+				bounds.grow(nodes_[node.firstChildOrItem + 1].bounds);
+			}
+
+			return bounds;
+		}
+
+		for (uint32_t i = 0; i < node.itemCount; i++) {
+			bounds.grow(itemBounds_[itemOrder_[node.firstChildOrItem + i]]);
+		}
+
+		return bounds;
+	}
+
+	// every item under the node
+	void appendItems(uint32_t nodeIndex, std::vector<uint32_t>& items) const {
+		std::vector<uint32_t> stack = { nodeIndex };
+
+		while (!stack.empty()) {
+			const BvhNode& node = nodes_[stack.back()];
+			stack.pop_back();
+
+			if (node.itemCount == 0) {
+				stack.push_back(node.firstChildOrItem);
+				stack.push_back(node.firstChildOrItem + 1);
+				continue;
+			}
+
+			items.insert(
+					items.end(),
+					itemOrder_.begin() + node.firstChildOrItem,
+					itemOrder_.begin() + node.firstChildOrItem + node.itemCount);
+		}
+	}
+
+	// false if the box is entirely outside one of the planes in planeMask,
+	// otherwise clears the planes it's entirely inside of from the mask
+	static bool classifyBox(const Frustum& frustum, const Aabb& box, uint32_t& planeMask) {
+		glm::vec3 center = box.getCenter();
+		glm::vec3 extent = box.max - center;
+
+		for (int i = 0; i < Frustum::kPlaneCount; i++) {
+			if (!(planeMask & (1 << i))) {
+				continue;
+			}
+
+			glm::vec3 normal(frustum.planes[i]);
+			float distance = glm::dot(normal, center) + frustum.planes[i].w;
+			float radius = glm::dot(glm::abs(normal), extent); // towards the plane
+
+			if (distance < -radius) {
+				return false;
+			}
+
+			if (distance >= radius) {
+				planeMask &= ~(1u << i);
+			}
+		}
+
+		return true;
+	}
+
+	// slab test, with the entry distance (clamped to 0) in distance
+	static bool intersectRay(
+			const glm::vec3& origin,
+			const glm::vec3& inverseDirection,
+			const Aabb& box,
+			float maxDistance,
+			float* distance = nullptr) {
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		float entry = std::max({ tNear.x, tNear.y, tNear.z, 0.0f });
+		float exit = std::min({ tFar.x, tFar.y, tFar.z, maxDistance });
+
+		if (entry > exit) {
+			return false;
+		}
+
+		if (distance != nullptr) {
+			*distance = entry;
+		}
+
+		return true;
+	}
+
+	static float getDistanceSquared(const Aabb& box, const glm::vec3& point) {
+		glm::vec3 closest = glm::min(glm::max(point, box.min), box.max);
+		glm::vec3 offset = point - closest;
+
+		return glm::dot(offset, offset);
+	}
+};
@@ -0,0 +1,273 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bvh.h"
+#include "frustum.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// times building, refitting and querying the BVH (bvh.h) with randomly
+// scattered spheres, and the linear scans it replaces, at a few scene sizes
+//
+//   make bvh_benchmark && ./bvh_benchmark
+//
+// the density stays the same at every size, so a query's results grow with
+// its own size, not the scene's
+
+// the best of several runs, in milliseconds, so one slow run doesn't count
+template <typename Function>
+double measure(uint32_t runCount, const Function& function) {
+	double best = 1e30;
+
+	for (uint32_t run = 0; run < runCount; run++) {
+		auto start = std::chrono::steady_clock::now();
+		function();
+		std::chrono::duration<double, std::milli> elapsed =
+				std::chrono::steady_clock::now() - start;
+
+		best = std::min(best, elapsed.count());
+	}
+
+	return best;
+}
+
+bool hitsBox(
+		const glm::vec3& origin,
+		const glm::vec3& inverseDirection,
+		const Aabb& box,
+		float* distance) {
+	glm::vec3 t0 = (box.min - origin) * inverseDirection;
+	glm::vec3 t1 = (box.max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float entry = std::max({ tNear.x, tNear.y, tNear.z, 0.0f });
+	float exit = std::min({ tFar.x, tFar.y, tFar.z });
+	*distance = entry;
+
+	return entry <= exit;
+}
+
+float getDistanceSquared(const Aabb& box, const glm::vec3& point) {
+	glm::vec3 offset = point - glm::min(glm::max(point, box.min), box.max);
+
+	return glm::dot(offset, offset);
+}
+
+void runBenchmark(uint32_t itemCount, WorkerPool& workerPool) {
+	// about one sphere per 1000 cubic units
+	float worldSize = 10.0f * std::cbrt(static_cast<float>(itemCount));
+
+	std::mt19937 random(itemCount);
+	std::uniform_real_distribution<float> position(0.0f, worldSize);
+	std::uniform_real_distribution<float> radius(0.5f, 1.5f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<float> centerX(itemCount);
+	std::vector<float> centerY(itemCount);
+	std::vector<float> centerZ(itemCount);
+	std::vector<float> radii(itemCount);
+	std::vector<Aabb> boxes(itemCount);
+
+	for (uint32_t i = 0; i < itemCount; i++) {
+		centerX[i] = position(random);
+		centerY[i] = position(random);
+		centerZ[i] = position(random);
+		radii[i] = radius(random);
+		boxes[i] = Aabb::fromSphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radii[i]);
+	}
+
+	// fewer runs for the big scenes, which take long enough to be steady
+	uint32_t runCount = itemCount <= 1000 ? 50 : (itemCount <= 100000 ? 5 : 2);
+
+	std::printf("%u objects\n", itemCount);
+
+	Bvh bvh;
+
+	double serialBuildTime = measure(runCount, [&]() {
+		bvh.build(boxes, nullptr);
+	});
+	double parallelBuildTime = measure(runCount, [&]() {
+		bvh.build(boxes, &workerPool);
+	});
+
+	std::printf(
+			"  build: %.3f ms on one thread, %.3f ms on %u (%zu nodes)\n",
+			serialBuildTime,
+			parallelBuildTime,
+			workerPool.getThreadCount(),
+			bvh.getNodeCount());
+
+	// everything drifts a little
+	std::vector<Aabb> movedBoxes = boxes;
+
+	for (Aabb& box : movedBoxes) {
+		glm::vec3 offset(unit(random), unit(random), unit(random));
+		box.min += offset;
+		box.max += offset;
+	}
+
+	double refitTime = measure(runCount, [&]() {
+		bvh.refit(movedBoxes);
+	});
+
+	// 1% of the objects move
+	uint32_t movedCount = std::max(1u, itemCount / 100);
+	std::vector<uint32_t> movedItems(movedCount);
+
+	for (uint32_t& item : movedItems) {
+		item = random() % itemCount;
+	}
+
+	double updateTime = measure(runCount, [&]() {
+		for (uint32_t item : movedItems) {
+			bvh.updateItem(item, boxes[item]);
+		}
+	});
+
+	std::printf(
+			"  refit: %.3f ms for every object, %.3f ms for %u moved ones\n",
+			refitTime,
+			updateTime,
+			movedCount);
+
+	bvh.build(boxes, &workerPool);
+
+	// a camera in one corner of the world looking at the middle, with a view
+	// distance that sees about the same number of objects at every size
+	glm::vec3 eye(0.0f);
+	glm::vec3 middle(worldSize * 0.5f);
+	glm::mat4 view = glm::lookAt(eye, middle, glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	Frustum frustum = Frustum::fromViewProjection(projection * view);
+
+	std::vector<uint32_t> visibleItems;
+	std::vector<uint8_t> visible(itemCount);
+	uint32_t linearVisibleCount = 0;
+
+	double bvhCullTime = measure(runCount * 10, [&]() {
+		visibleItems.clear();
+		bvh.cullFrustum(frustum, visibleItems);
+	});
+	double linearCullTime = measure(runCount * 10, [&]() {
+		linearVisibleCount = frustum.cullSpheres(
+				centerX.data(),
+				centerY.data(),
+				centerZ.data(),
+				radii.data(),
+				itemCount,
+				visible.data());
+	});
+
+	std::printf(
+			"  frustum cull: %.4f ms with the BVH (%zu visible), %.4f ms with the SSE scan (%u visible)\n",
+			bvhCullTime,
+			visibleItems.size(),
+			linearCullTime,
+			linearVisibleCount);
+
+	// rays from random points in random directions, and spheres around random
+	// points, checked against the linear scan so a broken BVH shows up
+	const uint32_t kQueryCount = 1000;
+	std::vector<glm::vec3> origins(kQueryCount);
+	std::vector<glm::vec3> directions(kQueryCount);
+
+	for (uint32_t i = 0; i < kQueryCount; i++) {
+		origins[i] = glm::vec3(position(random), position(random), position(random));
+		directions[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)));
+	}
+
+	// the linear scans get slow, so they only do some of the queries
+	uint32_t linearQueryCount = std::min(kQueryCount, 100000000 / itemCount);
+	uint32_t mismatchCount = 0;
+
+	std::vector<float> bvhHitDistances(kQueryCount, -1.0f);
+
+	double bvhRayTime = measure(runCount, [&]() {
+		for (uint32_t i = 0; i < kQueryCount; i++) {
+			std::optional<BvhRayHit> hit = bvh.raycast(origins[i], directions[i]);
+			bvhHitDistances[i] = hit ? hit->distance : -1.0f;
+		}
+	});
+	double linearRayTime = measure(1, [&]() {
+		for (uint32_t i = 0; i < linearQueryCount; i++) {
+			glm::vec3 inverseDirection(
+					1.0f / directions[i].x, 1.0f / directions[i].y, 1.0f / directions[i].z);
+			float nearest = -1.0f;
+
+			for (const Aabb& box : boxes) {
+				float distance;
+
+				if (hitsBox(origins[i], inverseDirection, box, &distance) &&
+						(nearest < 0.0f || distance < nearest)) {
+					nearest = distance;
+				}
+			}
+
+			mismatchCount += nearest != bvhHitDistances[i];
+		}
+	});
+
+	std::printf(
+			"  ray pick: %.2f us per ray with the BVH, %.2f us with a linear scan\n",
+			bvhRayTime * 1000.0 / kQueryCount,
+			linearRayTime * 1000.0 / linearQueryCount);
+
+	const float kQueryRadius = 10.0f;
+	std::vector<uint32_t> nearbyItems;
+	std::vector<size_t> bvhNearbyCounts(kQueryCount);
+
+	double bvhNearbyTime = measure(runCount, [&]() {
+		for (uint32_t i = 0; i < kQueryCount; i++) {
+			nearbyItems.clear();
+			bvh.findItemsInSphere(origins[i], kQueryRadius, nearbyItems);
+			bvhNearbyCounts[i] = nearbyItems.size();
+		}
+	});
+	double linearNearbyTime = measure(1, [&]() {
+		for (uint32_t i = 0; i < linearQueryCount; i++) {
+			size_t nearbyCount = 0;
+
+			for (const Aabb& box : boxes) {
+				nearbyCount += getDistanceSquared(box, origins[i]) <= kQueryRadius * kQueryRadius;
+			}
+
+			mismatchCount += nearbyCount != bvhNearbyCounts[i];
+		}
+	});
+
+	std::printf(
+			"  proximity (radius %.0f): %.2f us per query with the BVH, %.2f us with a linear scan\n",
+			kQueryRadius,
+			bvhNearbyTime * 1000.0 / kQueryCount,
+			linearNearbyTime * 1000.0 / linearQueryCount);
+
+	if (mismatchCount > 0) {
+		std::printf("  %u queries disagreed with the linear scan!\n", mismatchCount);
+	}
+
+	std::printf("\n");
+}
+
+int main() {
+	// every core, since there's nothing else running
+	WorkerPool workerPool;
+	workerPool.init(std::max(1u, std::thread::hardware_concurrency()));
+
+	for (uint32_t itemCount : { 1000u, 100000u, 1000000u }) {
+		runBenchmark(itemCount, workerPool);
+	}
+
+	return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+
+
+// GPU resources can't be destroyed while a submitted frame might still be
+// using them.  Instead of waiting for the whole device to go idle, we queue up
+// the destruction along with the number of the last frame that could be using
+// the resource, and run it once the GPU has finished that frame.
+struct DeletionQueue {
+	// lastUsedFrame is the number of the most recently submitted frame that may
+	// reference the resource
+	void push(uint64_t lastUsedFrame, std::function<void()>&& deleter) {
+		// frame numbers only ever increase, so the queue stays sorted
+		deleters_.emplace_back(lastUsedFrame, std::move(deleter));
+	}
+
+	// run every deleter whose frame has finished executing on the GPU
+	void flush(uint64_t completedFrame) {
+		while (!deleters_.empty() && deleters_.front().first <= completedFrame) {
+			// pop before calling, in case the deleter throws
+			auto deleter = std::move(deleters_.front().second);
+			deleters_.pop_front();
+			deleter();
+		}
+	}
+
+	// only safe once the device is idle
+	void flushAll() {
+		this->flush(UINT64_MAX);
+	}
+
+	size_t size() const {
+		return deleters_.size();
+	}
+
+	std::deque<std::pair<uint64_t, std::function<void()>>> deleters_;
+};
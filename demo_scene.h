@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scene.h"
+
+
+// the scene main.cpp draws, shared with pvs_builder so the PVS it builds is
+// for exactly what gets drawn
+const char* const kDemoModelFilename = "models/viking_room.obj";
+const char* const kDemoTextureFilename = "textures/viking_room.png";
+// built by make pvs
+const char* const kDemoPvsFilename = "models/viking_room.pvs";
+
+// copies of the model to draw, in a square grid
+// copies sharing a mesh and material are one instanced draw call, so try
+// raising this (and then run make pvs again)
+const int kModelGridSize = 1;
+
+void addModelGrid(
+		Scene& scene, MeshId meshId, MaterialId materialId, int gridSize) {
+	for (int x = 0; x < gridSize; x++) {
+		for (int y = 0; y < gridSize; y++) {
+			RenderableId id = scene.addRenderable(
+					meshId,
+					materialId,
+					glm::translate(glm::mat4(1.0f), glm::vec3(x * 2.5f, y * 2.5f, 0.0f)));
+
+			// the rooms are solid enough to hide whatever's behind them, but each
+			// one is a full mesh for the software rasterizer, so only the first row
+			// is tagged, which already hides most of the grid looking along y
+			if (y == 0) {
+				scene.setOccluder(id, true);
+			}
+		}
+	}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+// Hands out descriptor sets that only live for one frame.  Sets are never
+// freed individually; instead, once the frame's fence has signalled, every
+// pool the frame used is reset with vkResetDescriptorPool, which is far
+// cheaper than freeing sets or recreating pools.  When a pool runs out, a new
+// one is grabbed (reusing a reset pool if there is one), and each new pool is
+// bigger than the last, so the count settles after the first few frames.
+// Sets are counted as they're handed out, so a full pool is never allocated
+// from: without VK_KHR_maintenance1 that's invalid usage rather than an
+// out of pool memory error.
+// Keep one of these per frame in flight.
+struct DescriptorAllocator {
+	// poolSizes gives the number of descriptors of each type per set the pool
+	// can hold, e.g. { UNIFORM_BUFFER, 1 } for one uniform buffer per set, and
+	// every layout allocated with must fit in it
+	void init(
+			VkDevice device,
+			const std::vector<VkDescriptorPoolSize>& poolSizes,
+			uint32_t initialSetsPerPool = 16) {
+		this->device_ = device;
+		this->poolSizes_ = poolSizes;
+		this->setsPerPool_ = initialSetsPerPool;
+	}
+
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout) {
+		if (currentPoolSetsLeft_ == 0) {
+			currentPool_ = this->grabPool();
+			currentPoolSetsLeft_ = currentPool_.setCount;
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = currentPool_.pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet descriptorSet;
+
+		if (vkAllocateDescriptorSets(device_, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate transient descriptor set");
+		}
+
+		// the pool holds setCount times poolSizes_, so counting sets is enough
+		currentPoolSetsLeft_--;
+
+		return descriptorSet;
+	}
+
+	// only call once the GPU is done with every set handed out since the last
+	// reset, i.e. after waiting on the frame's fence
+	void reset() {
+		for (const Pool& pool : usedPools_) {
+			vkResetDescriptorPool(device_, pool.pool, 0);
+			freePools_.push_back(pool);
+		}
+
+		usedPools_.clear();
+		currentPool_ = Pool{};
+		currentPoolSetsLeft_ = 0;
+	}
+
+	void destroy() {
+		this->reset();
+
+		for (const Pool& pool : freePools_) {
+			vkDestroyDescriptorPool(device_, pool.pool, nullptr);
+		}
+
+		freePools_.clear();
+	}
+
+	size_t getPoolCount() const {
+		return usedPools_.size() + freePools_.size();
+	}
+
+ private:
+	struct Pool {
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		uint32_t setCount = 0; // the pool's maxSets
+	};
+
+	Pool grabPool() {
+		Pool pool;
+
+		if (!freePools_.empty()) {
+			pool = freePools_.back();
+			freePools_.pop_back();
+		} else {
+			pool.pool = this->createPool(setsPerPool_);
+			pool.setCount = setsPerPool_;
+
+			// grow, so a scene that needs lots of sets ends up with a few big pools
+			// instead of many small ones
+			setsPerPool_ = std::min(setsPerPool_ * 2, kMaxSetsPerPool);
+		}
+
+		usedPools_.push_back(pool);
+
+		return pool;
+	}
+
+	VkDescriptorPool createPool(uint32_t setCount) {
+		std::vector<VkDescriptorPoolSize> sizes = poolSizes_;
+
+		for (VkDescriptorPoolSize& size : sizes) {
+			size.descriptorCount *= setCount;
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = 0; // no FREE_DESCRIPTOR_SET_BIT, sets are only freed by resetting
+		poolInfo.maxSets = setCount;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
+		poolInfo.pPoolSizes = sizes.data();
+
+		VkDescriptorPool pool;
+
+		if (vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor pool");
+		}
+
+		return pool;
+	}
+
+	static constexpr uint32_t kMaxSetsPerPool = 4096;
+
+	VkDevice device_ = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPoolSize> poolSizes_;
+	uint32_t setsPerPool_ = 0;
+
+	Pool currentPool_;
+	uint32_t currentPoolSetsLeft_ = 0; // 0 with no current pool, too
+	std::vector<Pool> usedPools_; // allocated from since the last reset
+	std::vector<Pool> freePools_; // reset and ready to reuse
+};
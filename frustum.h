@@ -0,0 +1,134 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PHALANX_FRUSTUM_SSE 1
+#include <xmmintrin.h>
+#else
+#define PHALANX_FRUSTUM_SSE 0
+#endif
+
+
+// The six planes of the camera's view volume, pointing inwards, in world
+// space.  Each plane is (normal, distance), normalized, so dot(normal, point)
+// + distance is the signed distance from the plane.
+struct Frustum {
+	enum Plane { kLeft, kRight, kBottom, kTop, kNear, kFar, kPlaneCount };
+
+	glm::vec4 planes[kPlaneCount];
+
+	// Gribb/Hartmann plane extraction, for a projection with 0 to 1 depth
+	// (GLM_FORCE_DEPTH_ZERO_TO_ONE); the y flip doesn't matter since top and
+	// bottom just swap
+	static Frustum fromViewProjection(const glm::mat4& viewProjection) {
+		// glm is column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+		glm::vec4 rows[4];
+
+		for (int i = 0; i < 4; i++) {
+			rows[i] = glm::vec4(
+					viewProjection[0][i],
+					viewProjection[1][i],
+					viewProjection[2][i],
+					viewProjection[3][i]);
+		}
+
+		Frustum frustum;
+		frustum.planes[kLeft] = rows[3] + rows[0];
+		frustum.planes[kRight] = rows[3] - rows[0];
+		frustum.planes[kBottom] = rows[3] + rows[1];
+		frustum.planes[kTop] = rows[3] - rows[1];
+		frustum.planes[kNear] = rows[2];
+		frustum.planes[kFar] = rows[3] - rows[2];
+
+		for (glm::vec4& plane : frustum.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+
+		return frustum;
+	}
+
+	bool isSphereVisible(glm::vec3 center, float radius) const {
+		for (const glm::vec4& plane : planes) {
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Tests count spheres, given as separate arrays of x, y, z and radius, and
+	// writes 1 to visible[i] if sphere i is at least partly inside, 0 if not.
+	// Returns how many were visible.
+	// With SSE, four spheres are tested against a plane at once, which is why
+	// the scene keeps its bounds as a structure of arrays.
+	uint32_t cullSpheres(
+			const float* centerX,
+			const float* centerY,
+			const float* centerZ,
+			const float* radius,
+			size_t count,
+			uint8_t* visible) const {
+		uint32_t visibleCount = 0;
+		size_t i = 0;
+
+#if PHALANX_FRUSTUM_SSE
+		__m128 planeX[kPlaneCount];
+		__m128 planeY[kPlaneCount];
+		__m128 planeZ[kPlaneCount];
+		__m128 planeW[kPlaneCount];
+
+		for (int p = 0; p < kPlaneCount; p++) {
+			planeX[p] = _mm_set1_ps(planes[p].x);
+			planeY[p] = _mm_set1_ps(planes[p].y);
+			planeZ[p] = _mm_set1_ps(planes[p].z);
+			planeW[p] = _mm_set1_ps(planes[p].w);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps(centerX + i);
+			__m128 y = _mm_loadu_ps(centerY + i);
+			__m128 z = _mm_loadu_ps(centerZ + i);
+			__m128 r = _mm_loadu_ps(radius + i);
+
+			// all lanes start visible, and any plane a sphere is entirely behind
+			// clears its lane
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+
+			for (int p = 0; p < kPlaneCount; p++) {
+				__m128 distance = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])),
+						_mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+
+				// distance + radius >= 0
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+
+			for (int lane = 0; lane < 4; lane++) {
+				uint8_t laneVisible = (mask >> lane) & 1;
+				visible[i + lane] = laneVisible;
+				visibleCount += laneVisible;
+			}
+		}
+#endif
+
+		// whatever doesn't fill a group of four, or everything without SSE
+		for (; i < count; i++) {
+			bool sphereVisible = this->isSphereVisible(
+					glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i]);
+
+			visible[i] = sphereVisible ? 1 : 0;
+			visibleCount += sphereVisible ? 1 : 0;
+		}
+
+		return visibleCount;
+	}
+};
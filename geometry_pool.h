@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+
+
+// Hands out ranges of a fixed-size buffer, in whatever units the caller uses
+// (vertices, indices).  Free space is kept as a map of offset to size, so
+// neighbouring free blocks can be found and merged when a range is returned,
+// which keeps the pool from fragmenting as meshes come and go.
+struct FreeListAllocator {
+	FreeListAllocator(uint32_t capacity = 0) {
+		this->capacity_ = capacity;
+
+		if (capacity > 0) {
+			freeBlocks_[0] = capacity;
+		}
+	}
+
+	// first fit, which is plenty fast for the number of meshes we have
+	std::optional<uint32_t> allocate(uint32_t size) {
+		if (size == 0) {
+			return 0;
+		}
+
+		for (auto block = freeBlocks_.begin(); block != freeBlocks_.end(); block++) {
+			if (block->second < size) {
+				continue;
+			}
+
+			uint32_t offset = block->first;
+			uint32_t remaining = block->second - size;
+			freeBlocks_.erase(block);
+
+			if (remaining > 0) {
+				freeBlocks_[offset + size] = remaining;
+			}
+
+			usedSize_ += size;
+
+			return offset;
+		}
+
+		return std::nullopt;
+	}
+
+	void free(uint32_t offset, uint32_t size) {
+		if (size == 0) {
+			return;
+		}
+
+		usedSize_ -= size;
+
+		auto next = freeBlocks_.lower_bound(offset);
+
+		// merge with the block after, if it starts right where this one ends
+		if (next != freeBlocks_.end() && offset + size == next->first) {
+			size += next->second;
+			next = freeBlocks_.erase(next);
+		}
+
+		// and with the block before, if it ends right where this one starts
+		if (next != freeBlocks_.begin()) {
+			auto previous = std::prev(next);
+
+			if (previous->first + previous->second == offset) {
+				previous->second += size;
+				return;
+			}
+		}
+
+		freeBlocks_[offset] = size;
+	}
+
+	uint32_t getCapacity() const {
+		return capacity_;
+	}
+
+	uint32_t getUsedSize() const {
+		return usedSize_;
+	}
+
+	// the largest single allocation that would currently succeed
+	uint32_t getLargestFreeBlock() const {
+		uint32_t largest = 0;
+
+		for (const auto& block : freeBlocks_) {
+			largest = std::max(largest, block.second);
+		}
+
+		return largest;
+	}
+
+ private:
+	uint32_t capacity_ = 0;
+	uint32_t usedSize_ = 0;
+	std::map<uint32_t, uint32_t> freeBlocks_; // offset -> size
+};
+
+// where a mesh lives in the geometry pool, in vertices and indices rather
+// than bytes, which is what vkCmdDrawIndexed takes
+struct MeshRange {
+	uint32_t firstVertex = 0;
+	uint32_t vertexCount = 0;
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+};
+
+// One big vertex buffer and one big index buffer that every mesh is
+// suballocated from.  The buffers are bound once per frame, and draws pick
+// their mesh with firstIndex and vertexOffset, so switching meshes costs
+// nothing, and draws can later be packed into indirect buffers.
+// There's also a position buffer, with just the position of every vertex at
+// the same offsets, for the depth prepass.
+// The buffers themselves are created and filled by the renderer.
+struct GeometryPool {
+	std::optional<MeshRange> allocate(uint32_t vertexCount, uint32_t indexCount) {
+		std::optional<uint32_t> firstVertex = vertexAllocator_.allocate(vertexCount);
+
+		if (!firstVertex) {
+			return std::nullopt;
+		}
+
+		std::optional<uint32_t> firstIndex = indexAllocator_.allocate(indexCount);
+
+		if (!firstIndex) {
+			vertexAllocator_.free(*firstVertex, vertexCount);
+			return std::nullopt;
+		}
+
+		MeshRange range;
+		range.firstVertex = *firstVertex;
+		range.vertexCount = vertexCount;
+		range.firstIndex = *firstIndex;
+		range.indexCount = indexCount;
+
+		return range;
+	}
+
+	void free(const MeshRange& range) {
+		vertexAllocator_.free(range.firstVertex, range.vertexCount);
+		indexAllocator_.free(range.firstIndex, range.indexCount);
+	}
+
+	VkBuffer vertexBuffer_ = VK_NULL_HANDLE;
+	VkDeviceMemory vertexBufferMemory_ = VK_NULL_HANDLE;
+	VkBuffer positionBuffer_ = VK_NULL_HANDLE;
+	VkDeviceMemory positionBufferMemory_ = VK_NULL_HANDLE;
+	VkBuffer indexBuffer_ = VK_NULL_HANDLE;
+	VkDeviceMemory indexBufferMemory_ = VK_NULL_HANDLE;
+
+	FreeListAllocator vertexAllocator_;
+	FreeListAllocator indexAllocator_;
+};
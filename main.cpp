@@ -1,7 +1,6 @@
 // Currently, I have dynamic shader compilation working on Windows, but not on
-// macOS.  If this is set to 0, you must do the following before executing:
-// glslc shader.vert -o vert.spv
-// glslc shader.frag -o frag.spv
+// macOS.  If this is set to 0, you must run `make shaders` before executing,
+// which packs precompiled shaders into shaders/shaders.bundle
 #ifdef __APPLE__
 #define PHALANX_DYNAMIC_SHADER_COMPILATION 0
 #else
@@ -10,18 +9,61 @@
 
 
 #include "camera.h"
+#include "demo_scene.h"
 #include "model.h"
+#include "pvs.h"
 #include "renderer.h"
+#include "scene.h"
 #include "texture.h"
 #include "vertex.h"
 #include "window_handler.h"
 
 #include <chrono>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 
+// the PVS is optional, and only used by the CPU culling path, so a missing
+// or stale one just means culling the usual way
+void loadPvs(Scene& scene) {
+	Pvs pvs;
+
+	try {
+		pvs = Pvs::load(kDemoPvsFilename);
+	} catch (const std::exception&) {
+		std::cout << "no PVS at " << kDemoPvsFilename << ", run make pvs to build one\n";
+		return;
+	}
+
+	if (!scene.setPvs(std::move(pvs))) {
+		std::cout << kDemoPvsFilename << " is for a different scene, run make pvs again\n";
+		return;
+	}
+
+	std::cout << "PVS: " << scene.getPvs()->getCellCount() << " cells, " <<
+			scene.getPvs()->getSetCount() << " distinct visible sets\n";
+}
+
+// the mouse is captured for looking around, so clicking picks whatever is in
+// the middle of the screen
+void pickRenderable(Scene& scene, const Camera& camera) {
+	// cheap if nothing changed since the renderer last updated it
+	scene.updateBvh(nullptr);
+
+	std::optional<BvhRayHit> hit =
+			scene.pickRenderable(camera.position, camera.direction);
+
+	if (hit) {
+		std::cout << "picked renderable " << hit->item << ", " <<
+				hit->distance * glm::length(camera.direction) << " away\n";
+	} else {
+		std::cout << "picked nothing\n";
+	}
+}
+
 void maybeLogFPS() {
 	static auto lastPrintTime = std::chrono::steady_clock::now();
 	static uint32_t fps = 0;
@@ -45,16 +87,27 @@ int main() {
 		Camera camera{};
 
 		// load the model
-		Texture vikingRoomTexture = Texture::load("textures/viking_room.png");
-		Model vikingRoomModel = Model::load("models/viking_room.obj");
-		vikingRoomModel.texture = &vikingRoomTexture;
+		Texture vikingRoomTexture = Texture::load(kDemoTextureFilename);
+		Model vikingRoomModel = Model::load(kDemoModelFilename);
+
+		Scene scene;
+		MeshId vikingRoomMesh = scene.addMesh(&vikingRoomModel);
+		MaterialId vikingRoomMaterial = scene.addMaterial({ &vikingRoomTexture });
+		addModelGrid(scene, vikingRoomMesh, vikingRoomMaterial, kModelGridSize);
+		loadPvs(scene);
 
-		Renderer renderer(&windowHandler, &camera, &vikingRoomModel);
+		Renderer renderer(&windowHandler, &camera, &scene);
 
 		auto lastFrameTime = std::chrono::steady_clock::now();
 
 		while (renderer.isRunning()) {
 			windowHandler.pollEvents();
+
+			if (windowHandler.shouldPick()) {
+				windowHandler.resetShouldPick();
+				pickRenderable(scene, camera);
+			}
+
 			renderer.draw();
 			maybeLogFPS();
 
@@ -4,15 +4,28 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
-#include "texture.h"
 #include "vertex.h"
 
+#include <algorithm>
 
+
+// bounding volumes in the model's own space, for culling
+struct MeshBounds {
+	// axis-aligned box around every vertex
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	// sphere centered on the box, which is close enough to the smallest sphere
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+};
+
+// just the geometry; how it looks and where it goes are up to the Scene
 struct Model {
 	std::vector<Vertex> vertices;
 	// std::vector<uint16_t> indices;
 	std::vector<uint32_t> indices;
-	Texture* texture;
+	MeshBounds bounds;
 
 	static Model load(const char* filename) {
 		Model model;
@@ -53,6 +66,32 @@ struct Model {
 			}
 		}
 
+		model.computeBounds();
+
 		return model;
 	}
+
+	// call again if the vertices are changed after loading
+	void computeBounds() {
+		bounds = MeshBounds{};
+
+		if (vertices.empty()) {
+			return;
+		}
+
+		bounds.min = vertices[0].pos;
+		bounds.max = vertices[0].pos;
+
+		for (const Vertex& vertex : vertices) {
+			bounds.min = glm::min(bounds.min, vertex.pos);
+			bounds.max = glm::max(bounds.max, vertex.pos);
+		}
+
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+		for (const Vertex& vertex : vertices) {
+			bounds.radius =
+					std::max(bounds.radius, glm::length(vertex.pos - bounds.center));
+		}
+	}
 };
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PHALANX_OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#else
+#define PHALANX_OCCLUSION_SSE 0
+#endif
+
+
+// A small depth buffer on the CPU that a few big occluders (walls, buildings,
+// anything tagged with Scene::setOccluder) are rasterized into, so renderables
+// hidden behind them can be dropped before they're ever drawn.  It doesn't
+// touch the GPU at all, which makes it a fit for devices where the GPU culling
+// path is missing or too slow, like software Vulkan implementations.
+//
+// The buffer is split into horizontal bands, one per worker pool thread, and
+// every band gets every occluder triangle rasterized into just that band, so
+// no locking is needed.  Rows are filled four pixels at a time with SSE.  Alongside the
+// per-pixel depth, each 8x8 tile keeps the farthest depth in it, so most
+// queries are answered without looking at individual pixels.
+//
+// Depth is 0 to 1 like Vulkan's, with 1 the farthest, and the buffer keeps
+// the nearest occluder depth at each pixel.
+struct OcclusionRasterizer {
+	static const uint32_t kTileSize = 8;
+
+	// width and height have to be multiples of kTileSize
+	// the pool has to outlive the rasterizer
+	void init(uint32_t width, uint32_t height, WorkerPool* workerPool) {
+		if (width % kTileSize != 0 || height % kTileSize != 0) {
+			throw std::runtime_error("occlusion buffer size must be a multiple of the tile size");
+		}
+
+		width_ = width;
+		height_ = height;
+		tileColumnCount_ = width / kTileSize;
+		tileRowCount_ = height / kTileSize;
+		depth_.assign(width * height, 1.0f);
+		tileMaxDepth_.assign(tileColumnCount_ * tileRowCount_, 1.0f);
+
+		// bands are whole rows of tiles, so each band finishes its own tiles
+		workerPool_ = workerPool;
+		bandCount_ = std::max(
+				1u, std::min(workerPool->getThreadCount(), tileRowCount_));
+	}
+
+	// forgets last frame's occluders
+	void beginFrame() {
+		triangles_.clear();
+	}
+
+	// transforms the mesh to screen space and queues its triangles
+	// triangles that cross the near plane are dropped rather than clipped,
+	// which only means they hide a little less
+	void addOccluder(
+			const glm::mat4& modelViewProjection,
+			const std::vector<Vertex>& vertices,
+			const std::vector<uint32_t>& indices) {
+		screenVertices_.resize(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); i++) {
+			screenVertices_[i] =
+					this->toScreen(modelViewProjection * glm::vec4(vertices[i].pos, 1.0f));
+		}
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			const glm::vec4& v0 = screenVertices_[indices[i + 0]];
+			const glm::vec4& v1 = screenVertices_[indices[i + 1]];
+			const glm::vec4& v2 = screenVertices_[indices[i + 2]];
+
+			// w is left as 0 for anything at or behind the near plane
+			if (v0.w == 0.0f || v1.w == 0.0f || v2.w == 0.0f) {
+				continue;
+			}
+
+			this->setUpTriangle(glm::vec3(v0), glm::vec3(v1), glm::vec3(v2));
+		}
+	}
+
+	// rasterizes everything queued since beginFrame(), on every thread, and
+	// returns once the buffer is ready to query
+	void render() {
+		workerPool_->run(bandCount_, [this](uint32_t band) {
+			this->renderBand(band);
+		});
+	}
+
+	// whether any of the box could be in front of the occluders
+	// anything touching the near plane or off screen counts as visible, since
+	// the frustum test is what handles those
+	bool isBoxVisible(
+			const glm::vec3& boxMin,
+			const glm::vec3& boxMax,
+			const glm::mat4& viewProjection) const {
+		glm::vec2 screenMin(INFINITY);
+		glm::vec2 screenMax(-INFINITY);
+		float nearestDepth = 1.0f;
+
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 point(
+					(corner & 1) ? boxMax.x : boxMin.x,
+					(corner & 2) ? boxMax.y : boxMin.y,
+					(corner & 4) ? boxMax.z : boxMin.z);
+			glm::vec4 screen = this->toScreen(viewProjection * glm::vec4(point, 1.0f));
+
+			if (screen.w == 0.0f) {
+				return true;
+			}
+
+			screenMin = glm::min(screenMin, glm::vec2(screen.x, screen.y));
+			screenMax = glm::max(screenMax, glm::vec2(screen.x, screen.y));
+			nearestDepth = std::min(nearestDepth, screen.z);
+		}
+
+		if (
+				screenMax.x < 0.0f || screenMax.y < 0.0f ||
+				screenMin.x >= width_ || screenMin.y >= height_) {
+			return true;
+		}
+
+		// the pixels the box's rectangle touches, widened to groups of four so
+		// whole groups can be compared at once, which only makes it more likely
+		// to count as visible
+		uint32_t minX = static_cast<uint32_t>(std::max(screenMin.x, 0.0f)) & ~3u;
+		uint32_t minY = static_cast<uint32_t>(std::max(screenMin.y, 0.0f));
+		uint32_t maxX = static_cast<uint32_t>(std::min(screenMax.x, width_ - 1.0f)) | 3u;
+		uint32_t maxY = static_cast<uint32_t>(std::min(screenMax.y, height_ - 1.0f));
+
+		for (uint32_t tileY = minY / kTileSize; tileY <= maxY / kTileSize; tileY++) {
+			for (uint32_t tileX = minX / kTileSize; tileX <= maxX / kTileSize; tileX++) {
+				// every pixel in the tile is nearer than the box, so this part of it
+				// is hidden
+				if (tileMaxDepth_[tileY * tileColumnCount_ + tileX] < nearestDepth) {
+					continue;
+				}
+
+				uint32_t startX = std::max(minX, tileX * kTileSize);
+				uint32_t endX = std::min(maxX, tileX * kTileSize + kTileSize - 1);
+				uint32_t startY = std::max(minY, tileY * kTileSize);
+				uint32_t endY = std::min(maxY, tileY * kTileSize + kTileSize - 1);
+
+				for (uint32_t y = startY; y <= endY; y++) {
+					if (this->isRowVisible(&depth_[y * width_], startX, endX, nearestDepth)) {
+						return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+
+	uint32_t getTriangleCount() const {
+		return static_cast<uint32_t>(triangles_.size());
+	}
+
+ private:
+	// a triangle's edge functions and depth plane, each as a * x + b * y + c,
+	// set up once and evaluated by every band it overlaps
+	struct Triangle {
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		uint32_t minX;
+		uint32_t minY;
+		uint32_t maxX;
+		uint32_t maxY;
+	};
+
+	uint32_t width_ = 0;
+	uint32_t height_ = 0;
+	uint32_t tileColumnCount_ = 0;
+	uint32_t tileRowCount_ = 0;
+	std::vector<float> depth_; // row major
+	std::vector<float> tileMaxDepth_; // row major, one per tile
+
+	std::vector<glm::vec4> screenVertices_; // scratch for addOccluder()
+	std::vector<Triangle> triangles_;
+
+	WorkerPool* workerPool_ = nullptr;
+	uint32_t bandCount_ = 1;
+
+	// clip space to pixels, with depth in z, and w set to 1 if the point is in
+	// front of the near plane or 0 if it isn't
+	glm::vec4 toScreen(const glm::vec4& clip) const {
+		if (clip.w <= 1e-5f || clip.z < 0.0f) {
+			return glm::vec4(0.0f);
+		}
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+
+		return glm::vec4(
+				(ndc.x * 0.5f + 0.5f) * width_,
+				(ndc.y * 0.5f + 0.5f) * height_,
+				ndc.z,
+				1.0f);
+	}
+
+	void setUpTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+
+		// occluders are drawn from both sides, so just fix up the winding
+		if (area < 0.0f) {
+			std::swap(v1, v2);
+			area = -area;
+		}
+
+		// too thin to cover a pixel center
+		if (area < 1e-6f) {
+			return;
+		}
+
+		float minX = std::min({ v0.x, v1.x, v2.x });
+		float minY = std::min({ v0.y, v1.y, v2.y });
+		float maxX = std::max({ v0.x, v1.x, v2.x });
+		float maxY = std::max({ v0.y, v1.y, v2.y });
+
+		if (maxX < 0.0f || maxY < 0.0f || minX >= width_ || minY >= height_) {
+			return;
+		}
+
+		Triangle triangle;
+		const glm::vec3* vertices[3] = { &v0, &v1, &v2 };
+
+		// edge i runs from vertex i to the next one, and is positive on the inside
+		for (int i = 0; i < 3; i++) {
+			const glm::vec3& from = *vertices[i];
+			const glm::vec3& to = *vertices[(i + 1) % 3];
+
+			triangle.edgeA[i] = from.y - to.y;
+			triangle.edgeB[i] = to.x - from.x;
+			triangle.edgeC[i] = -triangle.edgeA[i] * from.x - triangle.edgeB[i] * from.y;
+		}
+
+		// depth is affine in screen space, so it's z0 plus the barycentric
+		// weights of v1 and v2 (edges 2 and 0, over the area) times their deltas
+		float dz1 = (v1.z - v0.z) / area;
+		float dz2 = (v2.z - v0.z) / area;
+		triangle.depthA = triangle.edgeA[2] * dz1 + triangle.edgeA[0] * dz2;
+		triangle.depthB = triangle.edgeB[2] * dz1 + triangle.edgeB[0] * dz2;
+		triangle.depthC = v0.z + triangle.edgeC[2] * dz1 + triangle.edgeC[0] * dz2;
+
+		// rows are walked in groups of four pixels, starting on a multiple of four
+		triangle.minX = static_cast<uint32_t>(std::max(minX, 0.0f)) & ~3u;
+		triangle.minY = static_cast<uint32_t>(std::max(minY, 0.0f));
+		triangle.maxX = static_cast<uint32_t>(std::min(maxX, width_ - 1.0f));
+		triangle.maxY = static_cast<uint32_t>(std::min(maxY, height_ - 1.0f));
+
+		triangles_.push_back(triangle);
+	}
+
+	// clears the band, draws every triangle that overlaps it, then updates the
+	// band's tiles
+	void renderBand(uint32_t band) {
+		uint32_t tileRowsPerBand = (tileRowCount_ + bandCount_ - 1) / bandCount_;
+		uint32_t bandMinY = band * tileRowsPerBand * kTileSize;
+		uint32_t bandMaxY = std::min((band + 1) * tileRowsPerBand * kTileSize, height_);
+
+		if (bandMinY >= bandMaxY) {
+			return;
+		}
+
+		std::fill(
+				depth_.begin() + bandMinY * width_,
+				depth_.begin() + bandMaxY * width_,
+				1.0f);
+
+		for (const Triangle& triangle : triangles_) {
+			uint32_t minY = std::max(triangle.minY, bandMinY);
+			uint32_t maxY = std::min(triangle.maxY, bandMaxY - 1);
+
+			for (uint32_t y = minY; y <= maxY; y++) {
+				this->rasterizeRow(triangle, y);
+			}
+		}
+
+		for (uint32_t tileY = bandMinY / kTileSize; tileY < bandMaxY / kTileSize; tileY++) {
+			for (uint32_t tileX = 0; tileX < tileColumnCount_; tileX++) {
+				float maxDepth = 0.0f;
+
+				for (uint32_t y = tileY * kTileSize; y < (tileY + 1) * kTileSize; y++) {
+					const float* row = &depth_[y * width_ + tileX * kTileSize];
+					maxDepth = std::max(maxDepth, *std::max_element(row, row + kTileSize));
+				}
+
+				tileMaxDepth_[tileY * tileColumnCount_ + tileX] = maxDepth;
+			}
+		}
+	}
+
+	// pixel centers are at half coordinates, and a pixel is covered when all
+	// three edge functions are non-negative there
+	void rasterizeRow(const Triangle& triangle, uint32_t y) {
+		float* row = &depth_[y * width_];
+		float centerY = y + 0.5f;
+		uint32_t x = triangle.minX;
+
+#if PHALANX_OCCLUSION_SSE
+		__m128 zero = _mm_setzero_ps();
+		__m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 edgeA[3];
+		__m128 edgeRow[3];
+
+		for (int i = 0; i < 3; i++) {
+			edgeA[i] = _mm_set1_ps(triangle.edgeA[i]);
+			edgeRow[i] = _mm_set1_ps(triangle.edgeB[i] * centerY + triangle.edgeC[i]);
+		}
+
+		__m128 depthA = _mm_set1_ps(triangle.depthA);
+		__m128 depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+
+		// minX is a multiple of four, and so is the width, so groups never run
+		// off the end of the row
+		for (; x <= triangle.maxX; x += 4) {
+			__m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+			__m128 inside = _mm_cmpge_ps(
+					_mm_add_ps(_mm_mul_ps(edgeA[0], centerX), edgeRow[0]), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(
+					_mm_add_ps(_mm_mul_ps(edgeA[1], centerX), edgeRow[1]), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(
+					_mm_add_ps(_mm_mul_ps(edgeA[2], centerX), edgeRow[2]), zero));
+
+			if (_mm_movemask_ps(inside) == 0) {
+				continue;
+			}
+
+			__m128 depth = _mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow);
+			__m128 oldDepth = _mm_loadu_ps(row + x);
+			__m128 newDepth = _mm_min_ps(oldDepth, depth);
+
+			_mm_storeu_ps(
+					row + x,
+					_mm_or_ps(
+							_mm_and_ps(inside, newDepth),
+							_mm_andnot_ps(inside, oldDepth)));
+		}
+#endif
+
+		// everything, without SSE
+		for (; x <= triangle.maxX; x++) {
+			float centerX = x + 0.5f;
+			bool inside = true;
+
+			for (int i = 0; i < 3; i++) {
+				inside = inside &&
+						triangle.edgeA[i] * centerX + triangle.edgeB[i] * centerY +
+								triangle.edgeC[i] >= 0.0f;
+			}
+
+			if (inside) {
+				float depth = triangle.depthA * centerX + triangle.depthB * centerY +
+						triangle.depthC;
+				row[x] = std::min(row[x], depth);
+			}
+		}
+	}
+
+	// whether any pixel from startX to endX is at least as far as depth
+	// startX is a multiple of four, and endX one less than a multiple of four
+	bool isRowVisible(
+			const float* row, uint32_t startX, uint32_t endX, float depth) const {
+		uint32_t x = startX;
+
+#if PHALANX_OCCLUSION_SSE
+		__m128 boxDepth = _mm_set1_ps(depth);
+
+		for (; x + 3 <= endX; x += 4) {
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)) != 0) {
+				return true;
+			}
+		}
+#endif
+
+		for (; x <= endX; x++) {
+			if (row[x] >= depth) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
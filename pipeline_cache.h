@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// The driver validates the data we hand to vkCreatePipelineCache, but not
+// every driver does it well, so we prefix the cache file with our own header
+// and throw the data away if it was written by a different device or driver.
+// The driver version isn't part of Vulkan's own cache header, so this also
+// catches driver updates that didn't bump the pipeline cache UUID.
+const uint32_t kPipelineCacheMagic = 0x50434843; // "PCHC"
+
+struct PipelineCacheFileHeader {
+	uint32_t magic;
+	uint32_t dataSize;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+PipelineCacheFileHeader makePipelineCacheFileHeader(
+		const VkPhysicalDeviceProperties& properties, size_t dataSize) {
+	PipelineCacheFileHeader header{};
+	header.magic = kPipelineCacheMagic;
+	header.dataSize = static_cast<uint32_t>(dataSize);
+	header.vendorID = properties.vendorID;
+	header.deviceID = properties.deviceID;
+	header.driverVersion = properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	return header;
+}
+
+// returns the cache data to seed vkCreatePipelineCache with, or nothing if the
+// file is missing or doesn't match this device
+std::vector<char> loadPipelineCacheData(
+		const std::string& filename, const VkPhysicalDeviceProperties& properties) {
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		std::cout << "no pipeline cache found at " << filename << std::endl;
+		return {};
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+
+	if (fileSize < sizeof(PipelineCacheFileHeader)) {
+		std::cout << "pipeline cache file is truncated, ignoring it\n";
+		return {};
+	}
+
+	file.seekg(0);
+
+	PipelineCacheFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	PipelineCacheFileHeader expected =
+			makePipelineCacheFileHeader(properties, header.dataSize);
+
+	if (
+			header.magic != expected.magic ||
+			header.vendorID != expected.vendorID ||
+			header.deviceID != expected.deviceID ||
+			header.driverVersion != expected.driverVersion ||
+			memcmp(
+					header.pipelineCacheUUID,
+					expected.pipelineCacheUUID,
+					VK_UUID_SIZE) != 0) {
+		std::cout << "pipeline cache was written by a different device or driver, ignoring it\n";
+		return {};
+	}
+
+	if (header.dataSize != fileSize - sizeof(PipelineCacheFileHeader)) {
+		std::cout << "pipeline cache file is truncated, ignoring it\n";
+		return {};
+	}
+
+	std::vector<char> data(header.dataSize);
+	file.read(data.data(), data.size());
+
+	// double check the driver's own header, which starts with its size and
+	// version, followed by the same vendor/device/UUID triple
+	VkPipelineCacheHeaderVersionOne driverHeader{};
+
+	if (data.size() < sizeof(driverHeader)) {
+		return {};
+	}
+
+	memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+
+	if (
+			driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+			driverHeader.vendorID != properties.vendorID ||
+			driverHeader.deviceID != properties.deviceID ||
+			memcmp(
+					driverHeader.pipelineCacheUUID,
+					properties.pipelineCacheUUID,
+					VK_UUID_SIZE) != 0) {
+		std::cout << "pipeline cache data header doesn't match this device, ignoring it\n";
+		return {};
+	}
+
+	return data;
+}
+
+void savePipelineCacheData(
+		const std::string& filename,
+		const VkPhysicalDeviceProperties& properties,
+		const std::vector<char>& data) {
+	// write to a temporary file first, so a crash mid-write can't leave a
+	// corrupt cache behind
+	std::string tempFilename = filename + ".tmp";
+	std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+		std::cerr << "failed to open " << tempFilename << " for writing\n";
+		return;
+	}
+
+	PipelineCacheFileHeader header =
+			makePipelineCacheFileHeader(properties, data.size());
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(data.data(), data.size());
+	file.close();
+
+	if (file.fail()) {
+		std::cerr << "failed to write pipeline cache\n";
+		std::remove(tempFilename.c_str());
+		return;
+	}
+
+	// rename() won't replace an existing file on Windows
+	std::remove(filename.c_str());
+
+	if (std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+		std::cerr << "failed to move pipeline cache into place\n";
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "shader_permutation.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+// rasterizer and depth state that is baked into the pipeline by default, but
+// set in the command buffer instead when VK_EXT_extended_dynamic_state is
+// available
+struct RasterState {
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	VkBool32 depthTestEnable = VK_TRUE;
+	VkBool32 depthWriteEnable = VK_TRUE;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+	bool operator==(const RasterState& other) const {
+		return cullMode == other.cullMode &&
+				frontFace == other.frontFace &&
+				depthTestEnable == other.depthTestEnable &&
+				depthWriteEnable == other.depthWriteEnable &&
+				depthCompareOp == other.depthCompareOp;
+	}
+};
+
+// Everything that makes one graphics pipeline different from another.
+// Materials and passes describe the pipeline they want, and the renderer hands
+// back a cached VkPipeline when one with the same description exists.  It's
+// all small enums, so comparing and hashing is cheap enough to do per draw.
+// Anything added here needs to go into operator== and hash() too.
+struct PipelineDescription {
+	ShaderPermutation shaderPermutation = kDefaultShaderPermutation;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL; // LINE or POINT requires enabling a GPU feature
+	VkBool32 blendEnable = VK_FALSE; // standard alpha blending when enabled
+	VkBool32 depthOnly = VK_FALSE; // positions only, no fragment shader or color writes
+	RasterState rasterState;
+
+	bool operator==(const PipelineDescription& other) const {
+		return shaderPermutation == other.shaderPermutation &&
+				topology == other.topology &&
+				polygonMode == other.polygonMode &&
+				blendEnable == other.blendEnable &&
+				depthOnly == other.depthOnly &&
+				rasterState == other.rasterState;
+	}
+
+	bool operator!=(const PipelineDescription& other) const {
+		return !(*this == other);
+	}
+
+	// hashes field by field rather than the raw bytes, since padding isn't
+	// guaranteed to be zeroed
+	uint64_t hash() const {
+		uint64_t hash = 0xcbf29ce484222325ULL;
+
+		auto combine = [&hash](uint64_t value) {
+			hash ^= value;
+			hash *= 0x100000001b3ULL;
+		};
+
+		combine(shaderPermutation);
+		combine(topology);
+		combine(polygonMode);
+		combine(blendEnable);
+		combine(depthOnly);
+		combine(rasterState.cullMode);
+		combine(rasterState.frontFace);
+		combine(rasterState.depthTestEnable);
+		combine(rasterState.depthWriteEnable);
+		combine(rasterState.depthCompareOp);
+
+		return hash;
+	}
+};
+
+struct PipelineDescriptionHash {
+	size_t operator()(const PipelineDescription& description) const {
+		return static_cast<size_t>(description.hash());
+	}
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// A potentially visible set, for scenes that don't move.  The space the camera
+// can be in is cut into a grid of cubic view cells, and every cell has a
+// bitset of the clusters (renderables, for now) that can be seen from
+// anywhere inside it.  Building one is slow, so it's done offline by
+// pvs_builder, and at runtime the camera's cell is found with a little
+// arithmetic and its bitset says what to skip, with no per-frame occlusion
+// work at all.
+//
+// Neighbouring cells tend to see the same things, so every distinct bitset is
+// only stored once, and cells refer to theirs by index.  The file layout is:
+//
+//   uint32 magic, uint32 version
+//   uint64 scene hash (see Scene::hashForPvs)
+//   float origin x, y, z, float cell size, uint32 cell counts x, y, z
+//   uint32 cluster count, uint32 set count
+//   uint32 per cell, its set's index, x fastest then y then z
+//   uint64 words per set times the set count, cluster i being bit i % 64 of
+//   word i / 64
+const uint32_t kPvsMagic = 0x56504850; // "PHPV"
+const uint32_t kPvsVersion = 1;
+
+struct Pvs {
+	static const uint32_t kNoCell = UINT32_MAX;
+
+	// cellBits has getWordCount(clusterCount) words per cell, in the same order
+	// as the cells in the file
+	static Pvs fromCells(
+			uint64_t sceneHash,
+			const glm::vec3& origin,
+			float cellSize,
+			const uint32_t cellCounts[3],
+			uint32_t clusterCount,
+			const std::vector<uint64_t>& cellBits) {
+		Pvs pvs;
+		pvs.sceneHash_ = sceneHash;
+		pvs.origin_ = origin;
+		pvs.cellSize_ = cellSize;
+		pvs.clusterCount_ = clusterCount;
+		pvs.wordCount_ = getWordCount(clusterCount);
+
+		for (int axis = 0; axis < 3; axis++) {
+			pvs.cellCounts_[axis] = cellCounts[axis];
+		}
+
+		uint32_t cellCount = cellCounts[0] * cellCounts[1] * cellCounts[2];
+
+		if (cellBits.size() != static_cast<size_t>(cellCount) * pvs.wordCount_) {
+			throw std::runtime_error("PVS cell bits don't match the cell and cluster counts");
+		}
+
+		// only building does this, so a map is plenty fast
+		std::map<std::vector<uint64_t>, uint32_t> setIndices;
+		pvs.cellSets_.resize(cellCount);
+
+		for (uint32_t cell = 0; cell < cellCount; cell++) {
+			auto bits = cellBits.begin() + static_cast<size_t>(cell) * pvs.wordCount_;
+			std::vector<uint64_t> set(bits, bits + pvs.wordCount_);
+
+			auto found = setIndices.find(set);
+
+			if (found == setIndices.end()) {
+				found = setIndices.emplace(set, static_cast<uint32_t>(setIndices.size())).first;
+				pvs.setBits_.insert(pvs.setBits_.end(), set.begin(), set.end());
+			}
+
+			pvs.cellSets_[cell] = found->second;
+		}
+
+		return pvs;
+	}
+
+	static Pvs load(const std::string& filename) {
+		std::ifstream file(filename, std::ios::binary);
+
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open " + filename);
+		}
+
+		std::vector<char> data(
+				(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		size_t position = 0;
+
+		auto read = [&](void* destination, size_t size) {
+			if (position + size > data.size()) {
+				throw std::runtime_error("PVS " + filename + " is truncated");
+			}
+
+			memcpy(destination, data.data() + position, size);
+			position += size;
+		};
+
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		read(&magic, sizeof(magic));
+		read(&version, sizeof(version));
+
+		if (magic != kPvsMagic || version != kPvsVersion) {
+			throw std::runtime_error(filename + " isn't a PVS, or is from an older version");
+		}
+
+		Pvs pvs;
+		uint32_t setCount = 0;
+		read(&pvs.sceneHash_, sizeof(pvs.sceneHash_));
+		read(&pvs.origin_.x, sizeof(float));
+		read(&pvs.origin_.y, sizeof(float));
+		read(&pvs.origin_.z, sizeof(float));
+		read(&pvs.cellSize_, sizeof(pvs.cellSize_));
+		read(pvs.cellCounts_, sizeof(pvs.cellCounts_));
+		read(&pvs.clusterCount_, sizeof(pvs.clusterCount_));
+		read(&setCount, sizeof(setCount));
+
+		pvs.wordCount_ = getWordCount(pvs.clusterCount_);
+		pvs.cellSets_.resize(pvs.cellCounts_[0] * pvs.cellCounts_[1] * pvs.cellCounts_[2]);
+		pvs.setBits_.resize(static_cast<size_t>(setCount) * pvs.wordCount_);
+
+		read(pvs.cellSets_.data(), pvs.cellSets_.size() * sizeof(uint32_t));
+		read(pvs.setBits_.data(), pvs.setBits_.size() * sizeof(uint64_t));
+
+		for (uint32_t set : pvs.cellSets_) {
+			if (set >= setCount) {
+				throw std::runtime_error("PVS " + filename + " refers to a missing set");
+			}
+		}
+
+		return pvs;
+	}
+
+	void save(const std::string& filename) const {
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open " + filename + " for writing");
+		}
+
+		auto write = [&](const void* source, size_t size) {
+			file.write(reinterpret_cast<const char*>(source), size);
+		};
+
+		uint32_t setCount = this->getSetCount();
+		write(&kPvsMagic, sizeof(kPvsMagic));
+		write(&kPvsVersion, sizeof(kPvsVersion));
+		write(&sceneHash_, sizeof(sceneHash_));
+		write(&origin_.x, sizeof(float));
+		write(&origin_.y, sizeof(float));
+		write(&origin_.z, sizeof(float));
+		write(&cellSize_, sizeof(cellSize_));
+		write(cellCounts_, sizeof(cellCounts_));
+		write(&clusterCount_, sizeof(clusterCount_));
+		write(&setCount, sizeof(setCount));
+		write(cellSets_.data(), cellSets_.size() * sizeof(uint32_t));
+		write(setBits_.data(), setBits_.size() * sizeof(uint64_t));
+
+		file.close();
+
+		if (file.fail()) {
+			std::remove(filename.c_str());
+			throw std::runtime_error("failed to write PVS " + filename);
+		}
+	}
+
+	// at least one, so even an empty scene's sets can be looked up
+	static uint32_t getWordCount(uint32_t clusterCount) {
+		return std::max(1u, (clusterCount + 63) / 64);
+	}
+
+	bool isEmpty() const {
+		return cellSets_.empty();
+	}
+
+	// kNoCell if the position is outside the grid, where nothing is known
+	uint32_t findCell(const glm::vec3& position) const {
+		if (this->isEmpty()) {
+			return kNoCell;
+		}
+
+		glm::vec3 offset = (position - origin_) * (1.0f / cellSize_);
+		uint32_t cell[3];
+
+		for (int axis = 0; axis < 3; axis++) {
+			float index = std::floor(offset[axis]);
+
+			if (!(index >= 0.0f && index < cellCounts_[axis])) {
+				return kNoCell;
+			}
+
+			cell[axis] = static_cast<uint32_t>(index);
+		}
+
+		return (cell[2] * cellCounts_[1] + cell[1]) * cellCounts_[0] + cell[0];
+	}
+
+	// getWordCount(getClusterCount()) words
+	const uint64_t* getVisibleBits(uint32_t cell) const {
+		return &setBits_[static_cast<size_t>(cellSets_[cell]) * wordCount_];
+	}
+
+	bool isVisible(uint32_t cell, uint32_t cluster) const {
+		return (this->getVisibleBits(cell)[cluster / 64] >> (cluster % 64)) & 1;
+	}
+
+	uint64_t getSceneHash() const {
+		return sceneHash_;
+	}
+
+	uint32_t getClusterCount() const {
+		return clusterCount_;
+	}
+
+	uint32_t getCellCount() const {
+		return static_cast<uint32_t>(cellSets_.size());
+	}
+
+	uint32_t getSetCount() const {
+		return static_cast<uint32_t>(setBits_.size() / wordCount_);
+	}
+
+	size_t getSizeInBytes() const {
+		return cellSets_.size() * sizeof(uint32_t) + setBits_.size() * sizeof(uint64_t);
+	}
+
+ private:
+	uint64_t sceneHash_ = 0;
+	glm::vec3 origin_ = glm::vec3(0.0f); // the grid's minimum corner
+	float cellSize_ = 1.0f;
+	uint32_t cellCounts_[3] = { 0, 0, 0 };
+	uint32_t clusterCount_ = 0;
+	uint32_t wordCount_ = 1; // per set
+
+	std::vector<uint32_t> cellSets_; // indexed by cell
+	std::vector<uint64_t> setBits_; // wordCount_ per set
+};
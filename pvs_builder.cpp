@@ -0,0 +1,286 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bvh.h"
+#include "demo_scene.h"
+#include "frustum.h"
+#include "model.h"
+#include "occlusion_rasterizer.h"
+#include "pvs.h"
+#include "scene.h"
+#include "texture.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// the offline PVS build for the scene in demo_scene.h:
+//
+//   pvs_builder [-j threads]
+//
+// the scene's bounds, plus a margin to move around in, are cut into cubic
+// view cells.  From sample points at every cell corner and center, the
+// scene's occluders are rasterized into a cube of small software depth
+// buffers (occlusion_rasterizer.h), and a renderable is visible from the
+// point if its bounds pass the depth test on any face.  A cell sees whatever
+// any of its samples see, plus anything whose bounds touch the cell.
+//
+// Sampling isn't exact: something only visible through a gap that falls
+// between samples can be missed, so keep cells small next to thin openings.
+
+const float kCellSize = 0.5f;
+// around the scene's bounds, so the camera can look at it from outside
+const float kMargin = 2.0f;
+
+// each cube face's depth buffer, a multiple of OcclusionRasterizer::kTileSize
+const uint32_t kFaceSize = 64;
+const float kNearPlane = 0.01f;
+const float kFarPlane = 1000.0f;
+
+struct CubeFace {
+	glm::vec3 direction;
+	glm::vec3 up;
+};
+
+const CubeFace kCubeFaces[6] = {
+	{ glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+	{ glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+	{ glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+	{ glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+	{ glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+	{ glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+};
+
+// sets the bit of every renderable that can be seen from the point, looking
+// in every direction
+void findVisibleRenderables(
+		const Scene& scene,
+		const std::vector<Aabb>& boxes,
+		OcclusionRasterizer& rasterizer,
+		const glm::vec3& point,
+		uint64_t* visibleBits) {
+	glm::mat4 projection = glm::perspective(
+			glm::radians(90.0f), 1.0f, kNearPlane, kFarPlane);
+	uint32_t renderableCount = static_cast<uint32_t>(scene.getRenderableCount());
+
+	for (const CubeFace& face : kCubeFaces) {
+		glm::mat4 viewProjection =
+				projection * glm::lookAt(point, point + face.direction, face.up);
+		Frustum frustum = Frustum::fromViewProjection(viewProjection);
+
+		auto isInFrustum = [&](RenderableId id) {
+			return frustum.isSphereVisible(
+					glm::vec3(
+							scene.boundsCenterX_[id],
+							scene.boundsCenterY_[id],
+							scene.boundsCenterZ_[id]),
+					scene.boundsRadius_[id]);
+		};
+
+		rasterizer.beginFrame();
+
+		for (RenderableId id = 0; id < renderableCount; id++) {
+			if (!scene.occluders_[id] || !isInFrustum(id)) {
+				continue;
+			}
+
+			const Model* mesh = scene.meshes_[scene.meshIds_[id]];
+
+			rasterizer.addOccluder(
+					viewProjection * scene.transforms_[id], mesh->vertices, mesh->indices);
+		}
+
+		// even with nothing to draw, since it's what clears the last face
+		rasterizer.render();
+
+		// the rasterizer counts anything off screen as visible, so the frustum
+		// test has to come first
+		for (RenderableId id = 0; id < renderableCount; id++) {
+			uint64_t bit = 1ull << (id % 64);
+
+			if ((visibleBits[id / 64] & bit) || !isInFrustum(id)) {
+				continue;
+			}
+
+			if (rasterizer.isBoxVisible(boxes[id].min, boxes[id].max, viewProjection)) {
+				visibleBits[id / 64] |= bit;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 1 && !(argc == 3 && std::string(argv[1]) == "-j")) {
+		std::cerr << "usage: " << argv[0] << " [-j threads]\n";
+		return EXIT_FAILURE;
+	}
+
+	unsigned int threadCount = argc == 3 ?
+			static_cast<unsigned int>(std::atoi(argv[2])) :
+			std::thread::hardware_concurrency();
+	threadCount = std::max(threadCount, 1u);
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	try {
+		// the same scene main.cpp draws
+		Texture texture = Texture::load(kDemoTextureFilename);
+		Model model = Model::load(kDemoModelFilename);
+
+		Scene scene;
+		MeshId mesh = scene.addMesh(&model);
+		MaterialId material = scene.addMaterial({ &texture });
+		addModelGrid(scene, mesh, material, kModelGridSize);
+
+		uint32_t renderableCount = static_cast<uint32_t>(scene.getRenderableCount());
+		uint32_t wordCount = Pvs::getWordCount(renderableCount);
+		std::vector<Aabb> boxes = scene.getRenderableBoxes();
+
+		Aabb sceneBounds;
+
+		for (const Aabb& box : boxes) {
+			sceneBounds.grow(box);
+		}
+
+		if (boxes.empty()) {
+			sceneBounds.grow(glm::vec3(0.0f));
+		}
+
+		glm::vec3 origin = sceneBounds.min - glm::vec3(kMargin);
+		glm::vec3 size = sceneBounds.max - sceneBounds.min + glm::vec3(2.0f * kMargin);
+		uint32_t cellCounts[3];
+
+		for (int axis = 0; axis < 3; axis++) {
+			cellCounts[axis] = std::max(
+					1u, static_cast<uint32_t>(std::ceil(size[axis] / kCellSize)));
+		}
+
+		// every cell corner, x fastest like the cells, then every cell center
+		uint32_t cornerCounts[3] = {
+			cellCounts[0] + 1, cellCounts[1] + 1, cellCounts[2] + 1
+		};
+		uint32_t cornerCount = cornerCounts[0] * cornerCounts[1] * cornerCounts[2];
+		uint32_t cellCount = cellCounts[0] * cellCounts[1] * cellCounts[2];
+		std::vector<glm::vec3> samples;
+		samples.reserve(cornerCount + cellCount);
+
+		for (int centered = 0; centered < 2; centered++) {
+			const uint32_t* counts = centered ? cellCounts : cornerCounts;
+			float offset = centered ? 0.5f : 0.0f;
+
+			for (uint32_t z = 0; z < counts[2]; z++) {
+				for (uint32_t y = 0; y < counts[1]; y++) {
+					for (uint32_t x = 0; x < counts[0]; x++) {
+						samples.push_back(origin + glm::vec3(
+								(x + offset) * kCellSize,
+								(y + offset) * kCellSize,
+								(z + offset) * kCellSize));
+					}
+				}
+			}
+		}
+
+		std::cout << cellCounts[0] << "x" << cellCounts[1] << "x" << cellCounts[2] <<
+				" cells of " << kCellSize << ", " << samples.size() << " samples, " <<
+				renderableCount << " renderables, on " << threadCount << " threads\n";
+
+		// every thread renders samples with its own rasterizer until they're
+		// all taken, and the rasterizers run their bands on the same thread
+		std::vector<uint64_t> sampleBits(samples.size() * wordCount, 0);
+		std::atomic<uint32_t> nextSample{0};
+
+		WorkerPool workerPool;
+		workerPool.init(threadCount);
+
+		workerPool.run(threadCount, [&](uint32_t) {
+			WorkerPool singleThread;
+			OcclusionRasterizer rasterizer;
+			rasterizer.init(kFaceSize, kFaceSize, &singleThread);
+
+			for (
+					uint32_t i = nextSample.fetch_add(1);
+					i < samples.size();
+					i = nextSample.fetch_add(1)) {
+				findVisibleRenderables(
+						scene, boxes, rasterizer, samples[i], &sampleBits[i * wordCount]);
+			}
+		});
+
+		workerPool.destroy();
+
+		std::vector<uint64_t> cellBits(static_cast<size_t>(cellCount) * wordCount, 0);
+		uint64_t visibleTotal = 0;
+
+		for (uint32_t z = 0; z < cellCounts[2]; z++) {
+			for (uint32_t y = 0; y < cellCounts[1]; y++) {
+				for (uint32_t x = 0; x < cellCounts[0]; x++) {
+					uint32_t cell = (z * cellCounts[1] + y) * cellCounts[0] + x;
+					uint64_t* bits = &cellBits[static_cast<size_t>(cell) * wordCount];
+
+					auto addSample = [&](uint32_t sample) {
+						for (uint32_t word = 0; word < wordCount; word++) {
+							bits[word] |= sampleBits[static_cast<size_t>(sample) * wordCount + word];
+						}
+					};
+
+					for (uint32_t corner = 0; corner < 8; corner++) {
+						uint32_t cornerX = x + (corner & 1);
+						uint32_t cornerY = y + ((corner >> 1) & 1);
+						uint32_t cornerZ = z + ((corner >> 2) & 1);
+						addSample((cornerZ * cornerCounts[1] + cornerY) * cornerCounts[0] + cornerX);
+					}
+
+					addSample(cornerCount + cell);
+
+					// the camera could be inside these, where no sample sees them
+					Aabb cellBox;
+					cellBox.min = origin + glm::vec3(x * kCellSize, y * kCellSize, z * kCellSize);
+					cellBox.max = cellBox.min + glm::vec3(kCellSize);
+
+					for (RenderableId id = 0; id < renderableCount; id++) {
+						const Aabb& box = boxes[id];
+
+						if (
+								box.min.x <= cellBox.max.x && box.max.x >= cellBox.min.x &&
+								box.min.y <= cellBox.max.y && box.max.y >= cellBox.min.y &&
+								box.min.z <= cellBox.max.z && box.max.z >= cellBox.min.z) {
+							bits[id / 64] |= 1ull << (id % 64);
+						}
+					}
+
+					for (uint32_t word = 0; word < wordCount; word++) {
+						visibleTotal += std::bitset<64>(bits[word]).count();
+					}
+				}
+			}
+		}
+
+		Pvs pvs = Pvs::fromCells(
+				scene.hashForPvs(), origin, kCellSize, cellCounts, renderableCount, cellBits);
+		pvs.save(kDemoPvsFilename);
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+		std::cout << "wrote " << kDemoPvsFilename << ": " << pvs.getSetCount() <<
+				" distinct visible sets, " << pvs.getSizeInBytes() << " bytes, " <<
+				static_cast<double>(visibleTotal) / cellCount <<
+				" renderables visible per cell on average, in " << elapsed.count() << "s\n";
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+// something to sort, and what it's sorted by
+// the value is usually an index into whatever the keys were built from
+struct SortItem {
+	uint64_t key;
+	uint32_t value;
+};
+
+// Least significant digit radix sort over 64-bit keys, a byte per pass, split
+// across a worker pool.  Every pass, each chunk of the input counts its own
+// histogram of the byte being sorted on, and the histograms are then turned
+// into where each chunk writes each byte value, so the chunks can scatter in
+// parallel and the sort stays stable.
+// Bytes that are the same in every key are skipped, so keys with unused bits
+// don't cost a pass for them.
+// The scratch memory is kept between calls, so sorting every frame doesn't
+// allocate once it's grown.
+struct RadixSorter {
+	void sort(std::vector<SortItem>& items, WorkerPool& workerPool) {
+		uint32_t count = static_cast<uint32_t>(items.size());
+
+		if (count <= 1) {
+			return;
+		}
+
+		// the bits that aren't the same in every key
+		uint64_t varyingBits = 0;
+
+		for (const SortItem& item : items) {
+			varyingBits |= item.key ^ items[0].key;
+		}
+
+		if (varyingBits == 0) {
+			return;
+		}
+
+		// small sorts aren't worth waking the workers for
+		uint32_t chunkCount = std::max(
+				1u, std::min(workerPool.getThreadCount(), count / kMinChunkSize));
+		uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+		scratch_.resize(count);
+		histograms_.resize(chunkCount);
+
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			if (((varyingBits >> shift) & 0xff) == 0) {
+				continue;
+			}
+
+			const SortItem* source = items.data();
+			SortItem* destination = scratch_.data();
+
+			workerPool.run(chunkCount, [&](uint32_t chunk) {
+				Histogram& histogram = histograms_[chunk];
+				histogram.fill(0);
+
+				uint32_t end = std::min(count, (chunk + 1) * chunkSize);
+
+				for (uint32_t i = chunk * chunkSize; i < end; i++) {
+					histogram[(source[i].key >> shift) & 0xff]++;
+				}
+			});
+
+			// each chunk's items with a given byte go after every item with a
+			// smaller byte, and after the earlier chunks' items with the same byte
+			uint32_t offset = 0;
+
+			for (uint32_t digit = 0; digit < 256; digit++) {
+				for (Histogram& histogram : histograms_) {
+					uint32_t digitCount = histogram[digit];
+					histogram[digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			workerPool.run(chunkCount, [&](uint32_t chunk) {
+				Histogram& offsets = histograms_[chunk];
+
+				uint32_t end = std::min(count, (chunk + 1) * chunkSize);
+
+				for (uint32_t i = chunk * chunkSize; i < end; i++) {
+					destination[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+				}
+			});
+
+			// the old input becomes the next pass's scratch
+			items.swap(scratch_);
+		}
+	}
+
+ private:
+	using Histogram = std::array<uint32_t, 256>;
+
+	// below this many items per thread, one chunk does the whole sort
+	static const uint32_t kMinChunkSize = 2048;
+
+	std::vector<SortItem> scratch_;
+	std::vector<Histogram> histograms_; // one per chunk
+};
@@ -9,21 +9,43 @@
 #include <vulkan/vulkan.h>
 
 #include "camera.h"
+#include "deletion_queue.h"
+#include "descriptor_allocator.h"
+#include "frustum.h"
+#include "geometry_pool.h"
 #include "model.h"
+#include "occlusion_rasterizer.h"
+#include "pipeline_cache.h"
+#include "pipeline_description.h"
+#include "pvs.h"
+#include "radix_sort.h"
+#include "scene.h"
+#include "shader_bundle.h"
 #include "shader_loader.h"
+#include "shader_permutation.h"
+#include "shader_watcher.h"
 #include "texture.h"
 #include "vertex.h"
 #include "window_handler.h"
+#include "worker_pool.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 
@@ -75,6 +97,72 @@ void DestroyDebugUtilsMessengerEXT(
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
+const char* const kPipelineCacheFilename = "pipeline_cache.bin";
+
+// size of the bindless texture table, if the device's descriptor limits allow
+const uint32_t kMaxTextures = 256;
+
+// size of the shared vertex and index buffers every mesh is allocated from
+const uint32_t kGeometryPoolVertexCapacity = 1 << 20;
+const uint32_t kGeometryPoolIndexCapacity = 1 << 22;
+
+// starting size of each frame's instance buffer, which grows as needed
+const uint32_t kInitialInstanceCapacity = 1024;
+
+// cull on the GPU when the device supports VK_KHR_draw_indirect_count,
+// otherwise (or if this is false) the CPU culls and builds the draws
+const bool kPreferGpuCulling = true;
+
+// must match local_size_x in cull.comp
+const uint32_t kCullWorkgroupSize = 64;
+
+// starting number of materials the GPU culling draw counts have room for
+const uint32_t kInitialDrawCountCapacity = 16;
+
+// must match kPhaseEarly and kPhaseLate in cull.comp
+const uint32_t kCullPhaseEarly = 0;
+const uint32_t kCullPhaseLate = 1;
+const uint32_t kCullPhaseCount = 2;
+
+// must match local_size_x and local_size_y in depth_reduce.comp
+const uint32_t kDepthReduceWorkgroupSize = 8;
+
+// without GPU culling, test renderables against occluders rasterized on the
+// CPU, see occlusion_rasterizer.h
+const bool kEnableSoftwareOcclusion = true;
+
+// the software occlusion buffer, multiples of OcclusionRasterizer::kTileSize
+// it doesn't need to match the window, just roughly its aspect ratio
+const uint32_t kOcclusionBufferWidth = 256;
+const uint32_t kOcclusionBufferHeight = 144;
+
+// whether to start with the depth prepass, which draws everything into the
+// depth buffer first so the main pass only shades the nearest surface
+// P toggles it while running, to compare with and without
+const bool kEnableDepthPrepass = false;
+
+// with at least this many renderables, the CPU culling path frustum culls by
+// walking the scene's BVH (bvh.h) instead of testing every bounding sphere
+// below it, the SSE scan over every sphere is faster (see bvh_benchmark.cpp)
+const uint32_t kBvhCullingMinRenderables = 4096;
+
+// the CPU culling path's draw sort keys, from the most significant bits down:
+// pipeline (12 bits), material (16), mesh (12), depth (20), with the top 4
+// bits left over
+// sorting them puts draws that share state next to each other, and orders
+// each run of them front to back, so early depth testing rejects as much as
+// possible
+// the mesh goes above the depth so a mesh's instances stay in one batch
+// ids too big for their field only cost batching, since batches are split on
+// the real ids
+const uint32_t kDrawKeyPipelineShift = 48;
+const uint32_t kDrawKeyMaterialShift = 32;
+const uint32_t kDrawKeyMeshShift = 20;
+const uint64_t kDrawKeyPipelineMask = 0xfff;
+const uint64_t kDrawKeyMaterialMask = 0xffff;
+const uint64_t kDrawKeyMeshMask = 0xfff;
+const uint64_t kDrawKeyDepthMask = 0xfffff;
+
 #ifdef NDEBUG
 const bool enableValidationLayers = true;
 #else
@@ -103,10 +191,29 @@ const std::vector<const char*> kDeviceExtensions = {
 // each element should be 16 byte aligned (?)
 // define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES before including glm to
 // automatically correct alignments (does not workf for nested structs)
-struct UniformBufferObject {
+// per-frame data, in descriptor set 0
+// view and projection are combined on the CPU, so the vertex shader doesn't
+// have to multiply them together for every vertex
+struct FrameUniforms {
+	alignas(16) glm::mat4 viewProjection;
+};
+
+// descriptor contents laid out the way the update templates read them, one
+// member per binding
+struct FrameDescriptorData {
+	VkDescriptorBufferInfo uniforms; // binding 0
+	VkDescriptorBufferInfo instances; // binding 1
+};
+
+// per-instance data, in a storage buffer in set 0 that the vertex shader
+// indexes with gl_InstanceIndex
+// the texture index lives here rather than in a push constant, so draws with
+// different materials can share one indirect call
+// std430 layout, padded out to a multiple of 16 bytes
+struct InstanceData {
 	alignas(16) glm::mat4 model;
-	alignas(16) glm::mat4 view;
-	alignas(16) glm::mat4 projection;
+	uint32_t textureIndex; // a slot in the texture table
+	uint32_t padding[3];
 };
 
 struct QueueFamilyIndices {
@@ -129,16 +236,151 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// a pipeline along with its layout and the render pass it was built against
+struct GraphicsPipeline {
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE; // shared by every pipeline, not owned
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+
+	// every shader source (or SPIR-V) file the pipeline was built from
+	std::set<std::string> shaderFiles;
+};
+
+// renderables that share a mesh and material, drawn with one instanced call
+// their instances are contiguous in the frame's instance buffer
+struct DrawBatch {
+	MeshId meshId;
+	MaterialId materialId;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+	uint64_t depthKey; // the depth bits of its first instance's sort key
+};
+
+// what's bound while recording a pass, so binds that wouldn't change anything
+// can be skipped
+struct BoundState {
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	std::optional<RasterState> rasterState; // the extended dynamic state
+	bool viewportSet = false;
+};
+
+// binds recorded for the last frame, for logging
+struct BindStats {
+	uint32_t pipelines = 0;
+	uint32_t dynamicStates = 0;
+	uint32_t descriptorSets = 0;
+	uint32_t vertexAndIndexBuffers = 0;
+
+	uint32_t getTotal() const {
+		return pipelines + dynamicStates + descriptorSets + vertexAndIndexBuffers;
+	}
+};
+
+// consecutive batches whose materials share a pipeline, drawn with one
+// vkCmdDrawIndexedIndirect over their commands in the frame's indirect buffer
+struct IndirectDrawGroup {
+	MaterialId materialId; // any of the group's materials, for the pipeline
+	VkPipeline pipeline;
+	uint32_t firstCommand;
+	uint32_t commandCount;
+};
+
+// per-renderable input to cull.comp, everything it needs to test the
+// renderable and write its draw command
+// std430 layout, padded out to a multiple of 16 bytes
+struct CullObject {
+	glm::vec4 sphere; // world space center in xyz, radius in w
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t materialId;
+	uint32_t commandOffset; // where the material's range of draw commands starts
+	uint32_t padding[3];
+};
+
+struct CullPushConstants {
+	uint32_t phase; // kCullPhaseEarly or kCullPhaseLate
+	uint32_t objectCount;
+};
+
+// the camera, as cull.comp sees it, written every frame
+// std140 layout, which the mat4 and vec4 array already line up with
+struct CullUniforms {
+	alignas(16) glm::mat4 view;
+	alignas(16) glm::vec4 frustumPlanes[Frustum::kPlaneCount];
+	float p00; // projection[0][0]
+	float p11; // projection[1][1]
+	float p22; // projection[2][2]
+	float p32; // projection[3][2]
+	float zNear;
+	uint32_t depthWidth;
+	uint32_t depthHeight;
+	uint32_t pyramidLevelCount;
+};
+
+// what one frame in flight needs for culling on the GPU
+struct CullBuffers {
+	// the scene's renderables as CullObjects, written when the scene changes
+	VkBuffer objectBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory objectBufferMemory = VK_NULL_HANDLE;
+	void* objectsMapped = nullptr;
+
+	// written by cull.comp, read by the indirect draws
+	// room for every renderable, split into one range per material
+	VkBuffer commandBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory commandBufferMemory = VK_NULL_HANDLE;
+
+	// how many commands cull.comp wrote for each material
+	VkBuffer countBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory countBufferMemory = VK_NULL_HANDLE;
+
+	// the counts copied back after each phase, for logging
+	VkBuffer countReadbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory countReadbackBufferMemory = VK_NULL_HANDLE;
+	void* countsReadbackMapped = nullptr;
+
+	// CullUniforms
+	VkBuffer uniformBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory uniformBufferMemory = VK_NULL_HANDLE;
+	void* uniformsMapped = nullptr;
+
+	uint32_t objectCapacity = 0;
+	uint32_t countCapacity = 0;
+	uint32_t objectCount = 0; // renderables in the object buffer
+	uint64_t sceneRevision = UINT64_MAX; // what's in the object buffer
+};
+
+// a texture uploaded to the GPU, which lives in a slot of the texture table
+struct TextureImage {
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+};
+
+// every pipeline built so far, keyed by what it was built from
+using GraphicsPipelines = std::unordered_map<
+		PipelineDescription, GraphicsPipeline, PipelineDescriptionHash>;
+
+// pipelines rebuilt on the pipeline build thread, waiting to be swapped in
+struct PendingPipelines {
+	VkRenderPass renderPass = VK_NULL_HANDLE; // what the build started with
+	GraphicsPipelines pipelines;
+};
+
 
 
 struct Renderer {
 	Renderer(
 			WindowHandler* windowHandler,
 			Camera* camera,
-			Model* model) {
+			Scene* scene) {
 		this->windowHandler_ = windowHandler;
 		this->camera_ = camera;
-		this->model_ = model;
+		this->scene_ = scene;
+
+		// meshes and materials are uploaded once, below
+		scene->lockMeshesAndMaterials();
+
 		this->initVulkan();
 	}
 
@@ -148,22 +390,29 @@ struct Renderer {
 		this->createSurface();
 		this->pickPhysicalDevice();
 		this->createLogicalDevice();
+		this->createPipelineCache();
+		this->loadShaderBundle();
 		this->createSwapChain();
 		this->createSwapChainImageViews();
 		this->createRenderPass();
-		this->createDescriptorSetLayout();
-		this->createGraphicsPipeline();
+		this->createDescriptorSetLayouts();
+		this->createPipelineLayout();
+		this->createDescriptorUpdateTemplates();
+		this->createGraphicsPipelines();
+		this->createCullPipeline();
 		this->createCommandPool();
 		this->createDepthResources();
+		this->createDepthPyramid();
 		this->createFrameBuffers();
-		this->createTextureImage();
-		this->createTextureImageView();
 		this->createTextureSampler();
-		this->createVertexBuffer();
-		this->createIndexBuffer();
+		this->createTextureTable();
+		this->createGeometryPool();
 		this->createUniformBuffers();
-		this->createDescriptorPool();
-		this->createDescriptorSets();
+		this->createInstanceBuffers();
+		this->createCullBuffers();
+		this->createWorkerPool();
+		this->createOcclusionRasterizer();
+		this->createFrameDescriptorAllocators();
 		this->createCommandBuffers();
 		this->createSyncObjects();
 	}
@@ -172,14 +421,63 @@ struct Renderer {
 		return !windowHandler_->wasWindowClosed();
 	}
 
+
 	void draw() {
-		if (windowHandler_->shouldRecreateSwapchain()) {
-			std::cout << "recreating swapchain\n";
-			this->recreateSwapChain("user requested swapchain reset");
-			windowHandler_->resetShouldRecreateSwapchain();
-		}
+		// this is the frame boundary, so it's safe to switch pipelines here
+		this->updatePipelineReload();
+		this->updateDepthPrepassToggle();
 
 		this->drawFrame();
+		this->maybeLogPipelineCacheStats();
+		this->maybeLogCullingStats();
+	}
+
+	// also a frame boundary, so the next frame just picks pipelines for the
+	// new setting
+	void updateDepthPrepassToggle() {
+		if (!windowHandler_->shouldToggleDepthPrepass()) {
+			return;
+		}
+
+		windowHandler_->resetShouldToggleDepthPrepass();
+		depthPrepassEnabled_ = !depthPrepassEnabled_;
+
+		std::cout << "depth prepass " << (depthPrepassEnabled_ ? "on" : "off") << "\n";
+	}
+
+	// counts are from the most recent frame rather than summed, since they
+	// only change when the camera or scene does
+	void maybeLogCullingStats() {
+		auto now = std::chrono::steady_clock::now();
+
+		if (now - lastCullingStatsTime_ < std::chrono::seconds(1)) {
+			return;
+		}
+
+		if (gpuCullingEnabled_) {
+			// read back from a frame that's MAX_FRAMES_IN_FLIGHT old
+			std::cout << "gpu frustum and occlusion culling: " << drawnRenderableCount_ <<
+					" drawn, " << culledRenderableCount_ << " culled, " <<
+					kCullPhaseCount * scene_->materials_.size() << " indirect draw calls\n";
+		} else {
+			size_t drawCallCount = batchedIndirectDrawsEnabled_ ?
+					indirectDrawGroups_.size() :
+					drawBatches_.size();
+
+			std::cout << "frustum culling: " << drawnRenderableCount_ << " drawn, " <<
+					culledRenderableCount_ << " culled (" << occludedRenderableCount_ <<
+					(pvsCell_ != Pvs::kNoCell ? " hidden by the PVS" : " occluded") <<
+					"), " << drawBatches_.size() << " batches in " <<
+					drawCallCount << " draw calls\n";
+		}
+
+		std::cout << "binds: " << bindStats_.getTotal() << " (" <<
+				bindStats_.pipelines << " pipelines, " <<
+				bindStats_.dynamicStates << " dynamic state, " <<
+				bindStats_.descriptorSets << " descriptor sets, " <<
+				bindStats_.vertexAndIndexBuffers << " vertex and index buffers)\n";
+
+		lastCullingStatsTime_ = now;
 	}
 
 	void drawFrame() {
@@ -194,6 +492,18 @@ struct Renderer {
 				VK_TRUE, // wait for all fences to be finished, although we're only passing in one here
 				UINT64_MAX);
 
+		// now that we know which frames the GPU is done with, destroy anything
+		// that was waiting on them
+		this->updateCompletedFrame();
+		deletionQueue_.flush(completedFrame_);
+
+		// and every descriptor set this frame slot handed out last time around
+		frameDescriptorAllocators_[currentFrame_].reset();
+
+		if (gpuCullingEnabled_) {
+			this->readCullingResults(currentFrame_);
+		}
+
 		uint32_t imageIndex;
 		VkResult acquireImageResult = vkAcquireNextImageKHR(
 				logicalDevice_,
@@ -232,7 +542,18 @@ struct Renderer {
 
 		imagesInFlight_[imageIndex] = inFlightFences_[currentFrame_];
 
-		this->updateUniformBuffer(imageIndex);
+		this->updateUniformBuffer(currentFrame_);
+
+		// with GPU culling, the CPU only touches renderables when the scene changes
+		if (gpuCullingEnabled_) {
+			this->updateCullBuffers(currentFrame_);
+		} else {
+			this->buildDrawBatches(currentFrame_);
+		}
+
+		// the fence wait above guarantees this frame's command buffer is no longer
+		// pending, so it's safe to record over it
+		this->recordCommandBuffer(commandBuffers_[currentFrame_], imageIndex);
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -245,7 +566,7 @@ struct Renderer {
 		submitInfo.pWaitDstStageMask = waitStages;
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers_[imageIndex];
+		submitInfo.pCommandBuffers = &commandBuffers_[currentFrame_];
 
 		// signals when command buffer has finished execution
 		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores_[currentFrame_] };
@@ -255,6 +576,11 @@ struct Renderer {
 		// fences need to be manually restored to the unsignalled state
 		vkResetFences(logicalDevice_, 1, &inFlightFences_[currentFrame_]);
 
+		// when this fence signals, every frame up to and including this one is
+		// done, because fence signals cover all previously submitted work
+		lastSubmittedFrame_++;
+		inFlightFrameNumbers_[currentFrame_] = lastSubmittedFrame_;
+
 		// when the frame is submitted, the fence will be signalled
 		if (
 				vkQueueSubmit(
@@ -299,28 +625,143 @@ struct Renderer {
 		currentFrame_ = (currentFrame_ + 1) % MAX_FRAMES_IN_FLIGHT;
 	}
 
+	// checks which submitted frames the GPU has finished, without blocking
+	void updateCompletedFrame() {
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			if (
+					inFlightFrameNumbers_[i] > completedFrame_ &&
+					vkGetFenceStatus(logicalDevice_, inFlightFences_[i]) == VK_SUCCESS) {
+				completedFrame_ = inFlightFrameNumbers_[i];
+			}
+		}
+	}
+
+	// destroys resources once every frame submitted so far has finished
+	// executing, without stalling the CPU
+	void deferDestruction(std::function<void()>&& deleter) {
+		deletionQueue_.push(lastSubmittedFrame_, std::move(deleter));
+	}
+
+	void deferDestroyBuffer(VkBuffer buffer, VkDeviceMemory bufferMemory) {
+		VkDevice device = logicalDevice_;
+		this->deferDestruction([device, buffer, bufferMemory]() {
+			vkDestroyBuffer(device, buffer, nullptr);
+			vkFreeMemory(device, bufferMemory, nullptr);
+		});
+	}
+
+	void deferDestroyImage(
+			VkImage image, VkImageView imageView, VkDeviceMemory imageMemory) {
+		VkDevice device = logicalDevice_;
+		this->deferDestruction([device, image, imageView, imageMemory]() {
+			vkDestroyImageView(device, imageView, nullptr);
+			vkDestroyImage(device, image, nullptr);
+			vkFreeMemory(device, imageMemory, nullptr);
+		});
+	}
+
+	void deferDestroyPipeline(VkPipeline pipeline) {
+		VkDevice device = logicalDevice_;
+		this->deferDestruction([device, pipeline]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+		});
+	}
+
 	void cleanup() {
 		// order matters in pretty much all cleanup actions
 
+		// the pipeline build thread uses the device, so it has to finish first
+		this->waitForPipelineBuild();
+
 		// wait for the logical device to finish all operations before cleaning up
+		// this is the only place we drain the device; everything else goes
+		// through the deletion queue
 		vkDeviceWaitIdle(logicalDevice_);
 
 		this->cleanupSwapChain();
 
+		// joins the worker threads
+		workerPool_.destroy();
+
+		if (pendingPipelines_) {
+			this->destroyPipelines(pendingPipelines_->pipelines);
+		}
+
+		this->destroyPipelines(graphicsPipelines_);
+		vkDestroyPipelineLayout(logicalDevice_, pipelineLayout_, nullptr);
+
+		if (gpuCullingEnabled_) {
+			vkDestroyPipeline(logicalDevice_, cullPipeline_, nullptr);
+			vkDestroyPipelineLayout(logicalDevice_, cullPipelineLayout_, nullptr);
+			vkDestroyDescriptorSetLayout(
+					logicalDevice_, cullDescriptorSetLayout_, nullptr);
+			vkDestroyPipeline(logicalDevice_, depthReducePipeline_, nullptr);
+			vkDestroyPipelineLayout(logicalDevice_, depthReducePipelineLayout_, nullptr);
+			vkDestroyDescriptorSetLayout(
+					logicalDevice_, depthReduceDescriptorSetLayout_, nullptr);
+			vkDestroySampler(logicalDevice_, depthPyramidSampler_, nullptr);
+
+			for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+				this->destroyCullBuffers(cullBuffers_[i]);
+			}
+
+			vkDestroyBuffer(logicalDevice_, visibilityBuffer_, nullptr);
+			vkFreeMemory(logicalDevice_, visibilityBufferMemory_, nullptr);
+			vkDestroyRenderPass(logicalDevice_, lateRenderPass_, nullptr);
+		}
+
+		vkDestroyRenderPass(logicalDevice_, renderPass_, nullptr);
+
+		// the device is idle, so anything still queued can go
+		deletionQueue_.flushAll();
+
 		vkDestroySampler(logicalDevice_, textureSampler_, nullptr);
-		vkDestroyImageView(logicalDevice_, textureImageView_, nullptr);
 
-		vkDestroyImage(logicalDevice_, textureImage_, nullptr);
-		vkFreeMemory(logicalDevice_, textureImageMemory_, nullptr);
+		for (const TextureImage& texture : textures_) {
+			vkDestroyImageView(logicalDevice_, texture.view, nullptr);
+			vkDestroyImage(logicalDevice_, texture.image, nullptr);
+			vkFreeMemory(logicalDevice_, texture.memory, nullptr);
+		}
+
+		// the texture table set is freed along with its pool
+		vkDestroyDescriptorPool(logicalDevice_, textureDescriptorPool_, nullptr);
+
+		if (descriptorUpdateTemplateSupported_) {
+			destroyDescriptorUpdateTemplate_(
+					logicalDevice_, frameDescriptorUpdateTemplate_, nullptr);
+		}
 
 		vkDestroyDescriptorSetLayout(
-				logicalDevice_, descriptorSetLayout_, nullptr);
+				logicalDevice_, frameDescriptorSetLayout_, nullptr);
+		vkDestroyDescriptorSetLayout(
+				logicalDevice_, textureDescriptorSetLayout_, nullptr);
+
+		for (DescriptorAllocator& allocator : frameDescriptorAllocators_) {
+			allocator.destroy();
+		}
 
-		vkDestroyBuffer(logicalDevice_, indexBuffer_, nullptr);
-		vkFreeMemory(logicalDevice_, indexBufferMemory_, nullptr);
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			vkDestroyBuffer(logicalDevice_, uniformBuffers_[i], nullptr);
+			vkFreeMemory(logicalDevice_, uniformBuffersMemory_[i], nullptr);
+
+			// freeing the memory unmaps it
+			vkDestroyBuffer(logicalDevice_, instanceBuffers_[i], nullptr);
+			vkFreeMemory(logicalDevice_, instanceBuffersMemory_[i], nullptr);
+
+			if (batchedIndirectDrawsEnabled_) {
+				vkDestroyBuffer(logicalDevice_, indirectBuffers_[i], nullptr);
+				vkFreeMemory(logicalDevice_, indirectBuffersMemory_[i], nullptr);
+			}
+		}
+
+		vkDestroyBuffer(logicalDevice_, geometryPool_.indexBuffer_, nullptr);
+		vkFreeMemory(logicalDevice_, geometryPool_.indexBufferMemory_, nullptr);
 
-		vkDestroyBuffer(logicalDevice_, vertexBuffer_, nullptr);
-		vkFreeMemory(logicalDevice_, vertexBufferMemory_, nullptr);
+		vkDestroyBuffer(logicalDevice_, geometryPool_.vertexBuffer_, nullptr);
+		vkFreeMemory(logicalDevice_, geometryPool_.vertexBufferMemory_, nullptr);
+
+		vkDestroyBuffer(logicalDevice_, geometryPool_.positionBuffer_, nullptr);
+		vkFreeMemory(logicalDevice_, geometryPool_.positionBufferMemory_, nullptr);
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			vkDestroySemaphore(
@@ -331,6 +772,10 @@ struct Renderer {
 		}
 
 		vkDestroyCommandPool(logicalDevice_, commandPool_, nullptr);
+
+		this->savePipelineCache();
+		vkDestroyPipelineCache(logicalDevice_, pipelineCache_, nullptr);
+
 		vkDestroyDevice(logicalDevice_, nullptr);
 
 		if (enableValidationLayers) {
@@ -471,9 +916,19 @@ struct Renderer {
 		// When getting this working on my M1 macOS device, I got a validation
 		// layer warning about needing this extension.  This post has more details:
 		// https://stackoverflow.com/questions/66659907/vulkan-validation-warning-catch-22-about-vk-khr-portability-subset-on-moltenvk
-#ifdef __APPLE__
-		requiredExtensions.push_back("VK_KHR_get_physical_device_properties2");
-#endif
+		// it's also needed to query optional device features (like extended
+		// dynamic state), so we enable it everywhere it's available
+		for (const auto& extension : availableExtensions) {
+			if (
+					strcmp(
+							extension.extensionName,
+							VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+				requiredExtensions.push_back(
+						VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+				physicalDeviceProperties2Enabled_ = true;
+				break;
+			}
+		}
 
 		// print required extensions
 		std::cout << "\n\n";
@@ -615,7 +1070,8 @@ struct Renderer {
 		return indices.isComplete() &&
 				extensionsSupported &&
 				swapChainAdequate &&
-				supportedFeatures.samplerAnisotropy;
+				supportedFeatures.samplerAnisotropy &&
+				supportedFeatures.shaderSampledImageArrayDynamicIndexing; // texture table lookups
 	}
 
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
@@ -684,6 +1140,25 @@ struct Renderer {
 		return requiredExtensions.empty();
 	}
 
+	bool isDeviceExtensionSupported(
+			VkPhysicalDevice device, const char* extensionName) {
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(
+				device, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(
+				device, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions) {
+			if (strcmp(extension.extensionName, extensionName) == 0) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
 	// **************************************************************************
 	// * Logical Device
 	// **************************************************************************
@@ -714,16 +1189,185 @@ struct Renderer {
 
 		VkPhysicalDeviceFeatures enabledDeviceFeatures{};
 		enabledDeviceFeatures.samplerAnisotropy = VK_TRUE;
+		enabledDeviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+		VkPhysicalDeviceFeatures supportedDeviceFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice_, &supportedDeviceFeatures);
+
+		std::vector<const char*> enabledExtensions(
+				kDeviceExtensions.begin(), kDeviceExtensions.end());
+
+		// optional features are chained onto the device create info through pNext
+		// the extension being present doesn't guarantee the feature is, so they
+		// have to be queried with vkGetPhysicalDeviceFeatures2KHR first
+		void* enabledFeatureChain = nullptr;
+		PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = nullptr;
+
+		if (physicalDeviceProperties2Enabled_) {
+			getFeatures2 =
+					(PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+							instance_, "vkGetPhysicalDeviceFeatures2KHR");
+		}
+
+		VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures{};
+		extendedDynamicStateFeatures.sType =
+				VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+
+		if (
+				getFeatures2 != nullptr &&
+				this->isDeviceExtensionSupported(
+						physicalDevice_, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+			features2.pNext = &extendedDynamicStateFeatures;
+			getFeatures2(physicalDevice_, &features2);
+
+			if (extendedDynamicStateFeatures.extendedDynamicState) {
+				enabledExtensions.push_back(
+						VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+				extendedDynamicStateSupported_ = true;
+
+				// the queried struct doubles as the enabled feature struct
+				extendedDynamicStateFeatures.pNext = enabledFeatureChain;
+				enabledFeatureChain = &extendedDynamicStateFeatures;
+			}
+		}
+
+		std::cout << "extended dynamic state: " <<
+				(extendedDynamicStateSupported_ ? "enabled" : "unsupported") << "\n\n";
+
+		// descriptor indexing lets the texture table be updated while it's bound,
+		// and have empty slots
+		// without it, every slot is filled in, and the table can only be written
+		// while no frames are in flight
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+		descriptorIndexingFeatures.sType =
+				VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+		if (
+				getFeatures2 != nullptr &&
+				this->isDeviceExtensionSupported(
+						physicalDevice_, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+				this->isDeviceExtensionSupported(
+						physicalDevice_, VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+			features2.pNext = &descriptorIndexingFeatures;
+			getFeatures2(physicalDevice_, &features2);
+
+			// the texture index is the same for a whole draw, so the table doesn't
+			// need shaderSampledImageArrayNonUniformIndexing, only the dynamic
+			// indexing core Vulkan already has
+			if (
+					descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+					descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+					descriptorIndexingFeatures.descriptorBindingPartiallyBound) {
+				enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+				enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+				descriptorIndexingSupported_ = true;
+
+				// only turn on what the texture table uses
+				VkPhysicalDeviceDescriptorIndexingFeaturesEXT supportedFeatures =
+						descriptorIndexingFeatures;
+				descriptorIndexingFeatures = {};
+				descriptorIndexingFeatures.sType = supportedFeatures.sType;
+				descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind =
+						VK_TRUE;
+				descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending =
+						VK_TRUE;
+				descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+
+				descriptorIndexingFeatures.pNext = enabledFeatureChain;
+				enabledFeatureChain = &descriptorIndexingFeatures;
+
+				// an update after bind table has its own limits, see
+				// createDescriptorSetLayouts
+				PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 =
+						(PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(
+								instance_, "vkGetPhysicalDeviceProperties2KHR");
+
+				VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+				indexingProperties.sType =
+						VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+				VkPhysicalDeviceProperties2 properties2{};
+				properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+				properties2.pNext = &indexingProperties;
+				getProperties2(physicalDevice_, &properties2);
+
+				maxUpdateAfterBindTextures_ = std::min({
+					indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+					indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+					indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+					indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages
+				});
+			}
+		}
+
+		std::cout << "descriptor indexing: " <<
+				(descriptorIndexingSupported_ ? "enabled" : "unsupported") << "\n\n";
+
+		// update templates write a whole descriptor set from one struct, and push
+		// descriptors put the frame set straight into the command buffer instead
+		// of allocating it from a pool
+		// both are optional, and we fall back to vkUpdateDescriptorSets
+		if (
+				this->isDeviceExtensionSupported(
+						physicalDevice_,
+						VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME)) {
+			enabledExtensions.push_back(
+					VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+			descriptorUpdateTemplateSupported_ = true;
+
+			// we only push descriptors through templates, and the extension also
+			// depends on VK_KHR_get_physical_device_properties2
+			if (
+					physicalDeviceProperties2Enabled_ &&
+					this->isDeviceExtensionSupported(
+							physicalDevice_, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME)) {
+				enabledExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+				pushDescriptorSupported_ = true;
+			}
+		}
+
+		// one indirect call can draw many batches, each with its own mesh, and
+		// the commands use firstInstance to say where their instances start
+		if (
+				supportedDeviceFeatures.multiDrawIndirect &&
+				supportedDeviceFeatures.drawIndirectFirstInstance) {
+			enabledDeviceFeatures.multiDrawIndirect = VK_TRUE;
+			enabledDeviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+			multiDrawIndirectEnabled_ = true;
+		}
+
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice_, &deviceProperties);
+		maxDrawIndirectCount_ = deviceProperties.limits.maxDrawIndirectCount;
+
+		// GPU culling writes one draw command per visible renderable, and the
+		// draw count comes from a buffer, so the CPU never sees what's visible
+		// on a software implementation the "GPU" is the CPU anyway, and the
+		// software occlusion test is much cheaper than a depth pyramid
+		if (
+				kPreferGpuCulling &&
+				multiDrawIndirectEnabled_ &&
+				deviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU &&
+				this->isDeviceExtensionSupported(
+						physicalDevice_, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+			gpuCullingEnabled_ = true;
+		}
 
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = enabledFeatureChain;
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.pEnabledFeatures = &enabledDeviceFeatures;
 
 		createInfo.enabledExtensionCount =
-				static_cast<uint32_t>(kDeviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = kDeviceExtensions.data();
+				static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		// newer implementations of Vulkan will ignore this, but we're including it
 		// for completeness I guess
@@ -751,6 +1395,151 @@ struct Renderer {
 				indices.presentFamily.value(), // queue family index
 				0, // queue index
 				&presentQueue_);
+
+		if (extendedDynamicStateSupported_) {
+			this->loadExtendedDynamicStateFunctions();
+		}
+
+		if (descriptorUpdateTemplateSupported_) {
+			this->loadDescriptorUpdateTemplateFunctions();
+		}
+
+		if (gpuCullingEnabled_) {
+			cmdDrawIndexedIndirectCount_ =
+					(PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+							logicalDevice_, "vkCmdDrawIndexedIndirectCountKHR");
+
+			if (cmdDrawIndexedIndirectCount_ == nullptr) {
+				std::cout << "couldn't find draw indirect count functions\n\n";
+				gpuCullingEnabled_ = false;
+			}
+		}
+
+		std::cout << "descriptor update templates: " <<
+				(descriptorUpdateTemplateSupported_ ? "enabled" : "unsupported") << "\n";
+		std::cout << "push descriptors: " <<
+				(pushDescriptorSupported_ ? "enabled" : "unsupported") << "\n";
+		// the CPU culling path batches into indirect calls when it can, GPU
+		// culling writes its own
+		batchedIndirectDrawsEnabled_ = multiDrawIndirectEnabled_ && !gpuCullingEnabled_;
+
+		std::cout << "multi-draw indirect: " <<
+				(multiDrawIndirectEnabled_ ? "enabled" : "unsupported") << "\n";
+		std::cout << "gpu culling: " <<
+				(gpuCullingEnabled_ ? "enabled" : "unsupported or disabled") << "\n\n";
+	}
+
+	// extension commands aren't exported by the loader, so we look them up the
+	// same way as the debug utils functions
+	void loadExtendedDynamicStateFunctions() {
+		cmdSetCullMode_ = (PFN_vkCmdSetCullModeEXT)vkGetDeviceProcAddr(
+				logicalDevice_, "vkCmdSetCullModeEXT");
+		cmdSetFrontFace_ = (PFN_vkCmdSetFrontFaceEXT)vkGetDeviceProcAddr(
+				logicalDevice_, "vkCmdSetFrontFaceEXT");
+		cmdSetDepthTestEnable_ = (PFN_vkCmdSetDepthTestEnableEXT)vkGetDeviceProcAddr(
+				logicalDevice_, "vkCmdSetDepthTestEnableEXT");
+		cmdSetDepthWriteEnable_ = (PFN_vkCmdSetDepthWriteEnableEXT)vkGetDeviceProcAddr(
+				logicalDevice_, "vkCmdSetDepthWriteEnableEXT");
+		cmdSetDepthCompareOp_ = (PFN_vkCmdSetDepthCompareOpEXT)vkGetDeviceProcAddr(
+				logicalDevice_, "vkCmdSetDepthCompareOpEXT");
+
+		if (
+				cmdSetCullMode_ == nullptr ||
+				cmdSetFrontFace_ == nullptr ||
+				cmdSetDepthTestEnable_ == nullptr ||
+				cmdSetDepthWriteEnable_ == nullptr ||
+				cmdSetDepthCompareOp_ == nullptr) {
+			std::cout << "couldn't find extended dynamic state functions\n\n";
+			extendedDynamicStateSupported_ = false;
+		}
+	}
+
+	void loadDescriptorUpdateTemplateFunctions() {
+		createDescriptorUpdateTemplate_ =
+				(PFN_vkCreateDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(
+						logicalDevice_, "vkCreateDescriptorUpdateTemplateKHR");
+		destroyDescriptorUpdateTemplate_ =
+				(PFN_vkDestroyDescriptorUpdateTemplateKHR)vkGetDeviceProcAddr(
+						logicalDevice_, "vkDestroyDescriptorUpdateTemplateKHR");
+		updateDescriptorSetWithTemplate_ =
+				(PFN_vkUpdateDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(
+						logicalDevice_, "vkUpdateDescriptorSetWithTemplateKHR");
+
+		if (
+				createDescriptorUpdateTemplate_ == nullptr ||
+				destroyDescriptorUpdateTemplate_ == nullptr ||
+				updateDescriptorSetWithTemplate_ == nullptr) {
+			std::cout << "couldn't find descriptor update template functions\n\n";
+			descriptorUpdateTemplateSupported_ = false;
+			pushDescriptorSupported_ = false;
+			return;
+		}
+
+		if (pushDescriptorSupported_) {
+			cmdPushDescriptorSetWithTemplate_ =
+					(PFN_vkCmdPushDescriptorSetWithTemplateKHR)vkGetDeviceProcAddr(
+							logicalDevice_, "vkCmdPushDescriptorSetWithTemplateKHR");
+
+			if (cmdPushDescriptorSetWithTemplate_ == nullptr) {
+				std::cout << "couldn't find push descriptor functions\n\n";
+				pushDescriptorSupported_ = false;
+			}
+		}
+	}
+
+	// **************************************************************************
+	// * Pipeline Cache
+	// **************************************************************************
+
+	// seeds the pipeline cache from disk, so pipelines compiled on a previous
+	// run don't have to go through the full driver compile again
+	void createPipelineCache() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+		std::vector<char> initialData =
+				loadPipelineCacheData(kPipelineCacheFilename, properties);
+		pipelineCacheWarm_ = !initialData.empty();
+
+		std::cout << "pipeline cache: " <<
+				(pipelineCacheWarm_ ? "warm" : "cold") <<
+				" (" << initialData.size() << " bytes)\n\n";
+
+		VkPipelineCacheCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = initialData.size();
+		createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+		if (
+				vkCreatePipelineCache(
+						logicalDevice_, &createInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline cache");
+		}
+	}
+
+	void savePipelineCache() {
+		// get the size first, then the data
+		size_t dataSize = 0;
+		vkGetPipelineCacheData(logicalDevice_, pipelineCache_, &dataSize, nullptr);
+
+		std::vector<char> data(dataSize);
+
+		if (
+				dataSize == 0 ||
+				vkGetPipelineCacheData(
+						logicalDevice_, pipelineCache_, &dataSize, data.data()) != VK_SUCCESS) {
+			std::cerr << "failed to get pipeline cache data\n";
+			return;
+		}
+
+		data.resize(dataSize);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+		savePipelineCacheData(kPipelineCacheFilename, properties, data);
+
+		std::cout << "saved pipeline cache (" << dataSize << " bytes)\n";
 	}
 
 	// **************************************************************************
@@ -814,7 +1603,7 @@ struct Renderer {
 		createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; // we don't want blending with other windows
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE; // we don't care about the color of obscured pixels
-		createInfo.oldSwapchain = VK_NULL_HANDLE; // assuming we only ever create one
+		createInfo.oldSwapchain = swapChain_; // the retired swap chain when recreating, which lets the driver reuse its resources
 
 		if (
 				vkCreateSwapchainKHR(
@@ -921,41 +1710,31 @@ struct Renderer {
 		}
 	}
 
+	// hands every swap chain-dependent resource to the deletion queue, so it's
+	// destroyed once the frames using it are done
 	void cleanupSwapChain() {
-		vkDestroyImageView(logicalDevice_, depthImageView_, nullptr);
-		vkDestroyImage(logicalDevice_, depthImage_, nullptr);
-		vkFreeMemory(logicalDevice_, depthImageMemory_, nullptr);
-
-		for (auto framebuffer : swapChainFramebuffers_) {
-			vkDestroyFramebuffer(logicalDevice_, framebuffer, nullptr);
-		}
-
-		// not recreating command pool, because it is wasteful (?)
-		vkFreeCommandBuffers(
-				logicalDevice_,
-				commandPool_,
-				static_cast<uint32_t>(commandBuffers_.size()),
-				commandBuffers_.data());
-
-		vkDestroyPipeline(logicalDevice_, graphicsPipeline_, nullptr);
-		vkDestroyPipelineLayout(logicalDevice_, pipelineLayout_, nullptr);
-		vkDestroyRenderPass(logicalDevice_, renderPass_, nullptr);
-
-		for (auto imageView : swapChainImageViews_) {
-			vkDestroyImageView(logicalDevice_, imageView, nullptr);
-		}
-
-		vkDestroySwapchainKHR(logicalDevice_, swapChain_, nullptr);
-
-		for (size_t i = 0; i < swapChainImages_.size(); i++) {
-			vkDestroyBuffer(logicalDevice_, uniformBuffers_[i], nullptr);
-			vkFreeMemory(logicalDevice_, uniformBuffersMemory_[i], nullptr);
-		}
+		this->deferDestroyImage(depthImage_, depthImageView_, depthImageMemory_);
+		this->deferDestroyDepthPyramid();
+
+		VkDevice device = logicalDevice_;
+		std::vector<VkFramebuffer> framebuffers = swapChainFramebuffers_;
+		std::vector<VkImageView> imageViews = swapChainImageViews_;
+		VkSwapchainKHR swapChain = swapChain_;
+
+		// command buffers are re-recorded every frame, and the render pass and
+		// pipeline don't depend on the swap chain extent, so none of them need to
+		// be torn down here
+		this->deferDestruction([device, framebuffers, imageViews, swapChain]() {
+			for (auto framebuffer : framebuffers) {
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+			}
 
-		vkDestroyDescriptorPool(logicalDevice_, descriptorPool_, nullptr);
+			for (auto imageView : imageViews) {
+				vkDestroyImageView(device, imageView, nullptr);
+			}
 
-		// descriptor sets don't need to be cleaned up, as they will be
-		// automatically freed when the descriptor pool is destroyed
+			vkDestroySwapchainKHR(device, swapChain, nullptr);
+		});
 	}
 
 	void recreateSwapChain(std::string reason) {
@@ -971,54 +1750,232 @@ struct Renderer {
 			std::cout << "window unminimized\n\n";
 		}
 
-		vkDeviceWaitIdle(logicalDevice_);
-
+		// no need to wait for the device to go idle, the old resources are
+		// destroyed by the deletion queue once the frames using them are done
 		std::cout << "recreating swap chain: " << reason << std::endl;
 
+		// the old swap chain handle stays valid until the deletion queue gets to
+		// it, so createSwapChain() can still pass it as oldSwapchain
 		this->cleanupSwapChain();
 
+		VkFormat oldImageFormat = swapChainImageFormat_;
+
 		this->createSwapChain();
 		this->createSwapChainImageViews(); // based directly on swap chain images
-		this->createRenderPass(); // depends on swap chain format (probably won't change, but handle it anyways)
-		this->createGraphicsPipeline(); // depends on viewport and scissor sizes (unless using dynamic state)
+
+		// the render pass depends on the swap chain format, which probably won't
+		// change, but handle it anyways
+		// viewport and scissor are dynamic state, so the pipeline survives resizes
+		if (swapChainImageFormat_ != oldImageFormat) {
+			std::cout << "swap chain format changed, recreating render pass\n";
+
+			// a background pipeline build may be using the old render pass
+			this->waitForPipelineBuild();
+
+			this->deferDestroyPipelines(graphicsPipelines_);
+
+			VkDevice device = logicalDevice_;
+			VkRenderPass renderPass = renderPass_;
+			VkRenderPass lateRenderPass = lateRenderPass_;
+			this->deferDestruction([device, renderPass, lateRenderPass]() {
+				vkDestroyRenderPass(device, renderPass, nullptr);
+				vkDestroyRenderPass(device, lateRenderPass, nullptr);
+			});
+
+			this->createRenderPass();
+			this->createGraphicsPipelines();
+		}
+
 		this->createDepthResources(); // depth image is same size as swapchain extents
+		this->createDepthPyramid(); // built from the depth image
 		this->createFrameBuffers(); // depends on swap chain images
-		this->createUniformBuffers();
-		this->createDescriptorPool();
-		this->createDescriptorSets();
 		// this->createCommandPool(); // don't need to recreate, can just reuse to recreate commad buffers
-		this->createCommandBuffers(); // depends on swap chain images
+
+		// the number of swap chain images may have changed
+		imagesInFlight_.assign(swapChainImages_.size(), VK_NULL_HANDLE);
 	}
 
 	// **************************************************************************
-	// * Image Views
+	// * Shader Hot Reload
 	// **************************************************************************
 
-	void createSwapChainImageViews() {
-		swapChainImageViews_.resize(swapChainImages_.size());
+	// compiling shaders and building a pipeline can take long enough to freeze
+	// the window, so reloads happen on a separate thread while the old pipeline
+	// keeps rendering, and the result is swapped in at the start of a frame
+	void updatePipelineReload() {
+		this->swapInPendingPipelines();
 
-		for (size_t i = 0; i < swapChainImages_.size(); i++) {
-			swapChainImageViews_[i] = this->createImageView(
-					swapChainImages_[i],
-					swapChainImageFormat_,
-					VK_IMAGE_ASPECT_COLOR_BIT);
+		if (windowHandler_->shouldReloadShaders()) {
+			windowHandler_->resetShouldReloadShaders();
+			pipelineReloadQueued_ = true;
+		}
+
+		// only rebuild for edits to files the pipelines are actually built from
+		for (const std::string& fileName : shaderWatcher_.pollChangedFiles()) {
+#if PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+			if (fileName == kShaderBundleFilename) {
+				shaderBundleChanged_ = true;
+			}
+#endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+
+			if (this->pipelinesUseShaderFile(fileName)) {
+				std::cout << fileName << " changed\n";
+				pipelineReloadQueued_ = true;
+			}
+		}
+
+		// if a build is already running, it may have read the shaders before the
+		// latest edit, so start another one once it's done
+		if (pipelineReloadQueued_ && !pipelineBuildInProgress_) {
+			pipelineReloadQueued_ = false;
+			this->startPipelineBuild();
 		}
 	}
 
-	VkImageView createImageView(
-			VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
-		VkImageViewCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		createInfo.image = image;
-		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	void startPipelineBuild() {
+		// the previous build has already finished, this just cleans up the thread
+		this->waitForPipelineBuild();
+
+#if PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+		// no build is reading the bundle now, so it's safe to replace
+		if (shaderBundleChanged_) {
+			shaderBundleChanged_ = false;
+
+			try {
+				this->loadShaderBundle();
+			} catch (const std::exception& e) {
+				std::cerr << "shader bundle reload failed, keeping the old one: " <<
+						e.what() << std::endl;
+			}
+		}
+#endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+
+		std::cout << "reloading graphics pipelines in the background\n";
+
+		pipelineBuildInProgress_ = true;
+		VkRenderPass renderPass = renderPass_;
+		// rebuild everything that's been requested so far, not just what the scene
+		// listed up front
+		std::vector<PipelineDescription> descriptions;
+
+		for (const auto& [description, pipeline] : graphicsPipelines_) {
+			descriptions.push_back(description);
+		}
+
+		pipelineBuildThread_ = std::thread([this, renderPass, descriptions]() {
+			try {
+				PendingPipelines pending;
+				pending.renderPass = renderPass;
+				pending.pipelines = this->buildGraphicsPipelines(renderPass, descriptions);
+
+				std::lock_guard<std::mutex> lock(pendingPipelineMutex_);
+				pendingPipelines_ = std::move(pending);
+			} catch (const std::exception& e) {
+				// the old pipelines are still valid, so just keep using them
+				std::cerr << "pipeline reload failed, keeping the old pipelines: " <<
+						e.what() << std::endl;
+			}
+
+			pipelineBuildInProgress_ = false;
+		});
+	}
+
+	// every precompiled shader comes from a single read of the bundle built by
+	// `make shaders`, which is kept around for later pipeline builds and only
+	// read again when the shader watcher sees it change
+	void loadShaderBundle() {
+#if PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+		shaderBundle_ = ShaderBundle::load(kShaderBundleFilename);
+#endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+	}
+
+	void waitForPipelineBuild() {
+		if (pipelineBuildThread_.joinable()) {
+			pipelineBuildThread_.join();
+		}
+	}
+
+	void swapInPendingPipelines() {
+		std::optional<PendingPipelines> pending;
+
+		{
+			std::lock_guard<std::mutex> lock(pendingPipelineMutex_);
+			std::swap(pending, pendingPipelines_);
+		}
+
+		if (!pending) {
+			return;
+		}
+
+		// the build can be empty, so check the render pass it started with rather
+		// than one of its pipelines
+		if (pending->renderPass != renderPass_) {
+			// the render pass was recreated during the build, so the new pipelines
+			// aren't compatible; they were never used, so destroy them right away
+			this->destroyPipelines(pending->pipelines);
+			return;
+		}
+
+		for (const auto& [description, pipeline] : graphicsPipelines_) {
+			if (pending->pipelines.count(description) == 0) {
+				// the build has every description it started with, so a cache miss
+				// added this one during it, from shaders at least as new as the
+				// build's; keep it rather than missing again next frame
+				pending->pipelines.emplace(description, pipeline);
+			} else {
+				// frames in flight may still be using the old pipelines
+				this->deferDestroyPipeline(pipeline.pipeline);
+			}
+		}
+
+		graphicsPipelines_ = std::move(pending->pipelines);
+
+		std::cout << "swapped in reloaded graphics pipelines\n";
+	}
+
+	bool pipelinesUseShaderFile(const std::string& fileName) {
+		for (const auto& [description, pipeline] : graphicsPipelines_) {
+			if (pipeline.shaderFiles.count(fileName) > 0) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// **************************************************************************
+	// * Image Views
+	// **************************************************************************
+
+	void createSwapChainImageViews() {
+		swapChainImageViews_.resize(swapChainImages_.size());
+
+		for (size_t i = 0; i < swapChainImages_.size(); i++) {
+			swapChainImageViews_[i] = this->createImageView(
+					swapChainImages_[i],
+					swapChainImageFormat_,
+					VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+	}
+
+	VkImageView createImageView(
+			VkImage image,
+			VkFormat format,
+			VkImageAspectFlags aspectFlags,
+			uint32_t baseMipLevel = 0,
+			uint32_t levelCount = 1) {
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = image;
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 		createInfo.format = format;
 		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
 		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
 		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 		createInfo.subresourceRange.aspectMask = aspectFlags;
-		createInfo.subresourceRange.baseMipLevel = 0;
-		createInfo.subresourceRange.levelCount = 1;
+		createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+		createInfo.subresourceRange.levelCount = levelCount;
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
@@ -1040,27 +1997,62 @@ struct Renderer {
 	// * Render Pass
 	// **************************************************************************
 
+	// with GPU culling, a frame is drawn in two passes, one for what cull.comp
+	// lets through before the depth pyramid is built and one for what it lets
+	// through after, so the first keeps its depth and doesn't present, and the
+	// second picks up where it left off
+	// they're compatible, so the same pipelines work with both
 	void createRenderPass() {
+		if (!gpuCullingEnabled_) {
+			renderPass_ = this->buildRenderPass(
+					VK_ATTACHMENT_LOAD_OP_CLEAR,
+					VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+					VK_ATTACHMENT_STORE_OP_DONT_CARE); // depth data won't be used after drawing is finished
+			return;
+		}
+
+		renderPass_ = this->buildRenderPass(
+				VK_ATTACHMENT_LOAD_OP_CLEAR,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_ATTACHMENT_STORE_OP_STORE); // the depth pyramid is built from it
+		lateRenderPass_ = this->buildRenderPass(
+				VK_ATTACHMENT_LOAD_OP_LOAD,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE);
+	}
+
+	// loadOp applies to both color and depth, and a pass that loads expects
+	// them to be in their attachment layouts already
+	VkRenderPass buildRenderPass(
+			VkAttachmentLoadOp loadOp,
+			VkImageLayout colorFinalLayout,
+			VkAttachmentStoreOp depthStoreOp) {
+		bool loadAttachments = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+
 		// create single color buffer attachment represented by one image from the
 		// swap chain
 		VkAttachmentDescription colorAttachment{};
 		colorAttachment.format = swapChainImageFormat_;
 		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT; // no multisampling yet
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; // clear the framebuffer to black before drawing a new frame
+		colorAttachment.loadOp = loadOp; // clear the framebuffer to black before drawing a new frame
 		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE; // store rendered contents in memory, so we can show it on screen
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // not using stencil buffer
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // not using stencil buffer
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // used for texturing, we don't care about the initial layout
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // used for texturing, want the image to be ready for presentation after rendering
+		colorAttachment.initialLayout = loadAttachments ?
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL :
+				VK_IMAGE_LAYOUT_UNDEFINED; // used for texturing, we don't care about the initial layout
+		colorAttachment.finalLayout = colorFinalLayout; // want the image to be ready for presentation after rendering
 
 		VkAttachmentDescription depthAttachment{};
 		depthAttachment.format = this->findDepthFormat();
 		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // depth data won't be used after drawing is finished
+		depthAttachment.loadOp = loadOp;
+		depthAttachment.storeOp = depthStoreOp;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.initialLayout = loadAttachments ?
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL :
+				VK_IMAGE_LAYOUT_UNDEFINED;
 		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		std::array<VkAttachmentDescription, 2> attachments = {
@@ -1100,6 +2092,17 @@ struct Renderer {
 		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
 				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT; // and action that are doing the waiting
 
+		// a pass that loads also has to wait for the previous pass's writes
+		// before reading them
+		if (loadAttachments) {
+			dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			dependency.dstStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependency.dstAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		}
+
 		VkRenderPassCreateInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
@@ -1109,30 +2112,165 @@ struct Renderer {
 		renderPassInfo.dependencyCount = 1;
 		renderPassInfo.pDependencies = &dependency;
 
+		VkRenderPass renderPass;
+
 		if (
 				vkCreateRenderPass(
-						logicalDevice_, &renderPassInfo, nullptr, &renderPass_) != VK_SUCCESS) {
+						logicalDevice_, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass");
 		}
+
+		return renderPass;
 	}
 
 	// **************************************************************************
 	// * Graphics Pipeline
 	// **************************************************************************
 
-	void createGraphicsPipeline() {
+	// every pipeline uses the same descriptor sets, so they share a single
+	// layout that lives as long as the renderer
+	void createPipelineLayout() {
+		// set 0 changes once per frame, and set 1 is the texture table, which is
+		// shared by every draw
+		// everything per draw (transforms, texture indices) is per instance, in
+		// the instance buffer, so there are no push constants
+		std::array<VkDescriptorSetLayout, 2> setLayouts = {
+			frameDescriptorSetLayout_,
+			textureDescriptorSetLayout_
+		};
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = 0;
+		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+		if (
+				vkCreatePipelineLayout(
+						logicalDevice_,
+						&pipelineLayoutInfo,
+						nullptr,
+						&pipelineLayout_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout");
+		}
+	}
+
+	// builds everything the scene is known to need up front, so drawing doesn't
+	// stall on pipeline cache misses
+	void createGraphicsPipelines() {
+		std::vector<PipelineDescription> descriptions;
+
+		for (const PipelineDescription& description :
+				this->getScenePipelineDescriptions()) {
+			PipelineDescription key = this->normalizePipelineDescription(description);
+
+			if (std::find(descriptions.begin(), descriptions.end(), key) ==
+					descriptions.end()) {
+				descriptions.push_back(key);
+			}
+		}
+
+		graphicsPipelines_ = this->buildGraphicsPipelines(renderPass_, descriptions);
+	}
+
+	// one per material with and without the depth prepass, since it can be
+	// toggled at any time, and the prepass itself
+	// duplicates are dropped by the caller
+	std::vector<PipelineDescription> getScenePipelineDescriptions() {
+		std::vector<PipelineDescription> descriptions;
+
+		for (MaterialId id = 0; id < scene_->materials_.size(); id++) {
+			descriptions.push_back(this->getMaterialPipelineDescription(id, false));
+			descriptions.push_back(this->getMaterialPipelineDescription(id, true));
+		}
+
+		descriptions.push_back(this->getDepthPrepassPipelineDescription());
+
+		return descriptions;
+	}
+
+	// after a depth prepass, the depth buffer already holds the nearest
+	// surface, so only fragments at exactly that depth get shaded, and there's
+	// nothing left to write
+	PipelineDescription getMaterialPipelineDescription(
+			MaterialId materialId, bool afterDepthPrepass) {
+		PipelineDescription description;
+		description.shaderPermutation =
+				scene_->materials_[materialId].shaderPermutation;
+		description.rasterState = rasterState_;
+
+		if (afterDepthPrepass) {
+			description.rasterState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+			description.rasterState.depthWriteEnable = VK_FALSE;
+		}
+
+		return description;
+	}
+
+	// one pipeline for every material, since it only writes depth
+	PipelineDescription getDepthPrepassPipelineDescription() {
+		PipelineDescription description;
+		description.depthOnly = VK_TRUE;
+		description.rasterState = rasterState_;
+
+		return description;
+	}
+
+	void destroyPipelines(const GraphicsPipelines& pipelines) {
+		for (const auto& [description, pipeline] : pipelines) {
+			vkDestroyPipeline(logicalDevice_, pipeline.pipeline, nullptr);
+		}
+	}
+
+	void deferDestroyPipelines(const GraphicsPipelines& pipelines) {
+		for (const auto& [description, pipeline] : pipelines) {
+			this->deferDestroyPipeline(pipeline.pipeline);
+		}
+	}
+
+	// builds one pipeline per description from a single set of shader modules,
+	// since shader permutations only differ in their specialization constants
+	// this runs on the pipeline build thread during hot reloads, so it must only
+	// read renderer state that doesn't change while a build is running (the
+	// pipeline cache is internally synchronized, and the shader bundle is only
+	// replaced between builds)
+	GraphicsPipelines buildGraphicsPipelines(
+			VkRenderPass renderPass,
+			const std::vector<PipelineDescription>& descriptions) {
+		std::set<std::string> shaderFiles;
+
 		// set up vertex and fragment shaders
 
 #if PHALANX_DYNAMIC_SHADER_COMPILATION == 1
-		std::vector<char> vertShaderIRCode = loadVertexShader("shaders/shader.vert");
-		std::vector<char> fragShaderIRCode = loadFragmentShader("shaders/shader.frag");
+		const std::string vertShaderFileName = "shaders/shader.vert";
+		const std::string fragShaderFileName = "shaders/shader.frag";
+		const std::string depthShaderFileName = "shaders/depth_prepass.vert";
+
+		// includes count too, so editing a shared file reloads every stage using it
+		shaderFiles = getShaderDependencies(vertShaderFileName);
+		std::set<std::string> fragShaderFiles =
+				getShaderDependencies(fragShaderFileName);
+		shaderFiles.insert(fragShaderFiles.begin(), fragShaderFiles.end());
+		std::set<std::string> depthShaderFiles =
+				getShaderDependencies(depthShaderFileName);
+		shaderFiles.insert(depthShaderFiles.begin(), depthShaderFiles.end());
+
+		std::vector<char> vertShaderIRCode = loadVertexShader(vertShaderFileName);
+		std::vector<char> fragShaderIRCode = loadFragmentShader(fragShaderFileName);
+		std::vector<char> depthShaderIRCode = loadVertexShader(depthShaderFileName);
 #else
-		std::vector<char> vertShaderIRCode = readFile("shaders/vert.spv");
-		std::vector<char> fragShaderIRCode = readFile("shaders/frag.spv");
+		// rebuilding the bundle is enough to trigger a reload
+		shaderFiles = {kShaderBundleFilename};
+
+		std::vector<char> vertShaderIRCode = shaderBundle_.getSpirV("shader.vert");
+		std::vector<char> fragShaderIRCode = shaderBundle_.getSpirV("shader.frag");
+		std::vector<char> depthShaderIRCode = shaderBundle_.getSpirV("depth_prepass.vert");
 #endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 1
 
 		VkShaderModule vertShaderModule = createShaderModule(vertShaderIRCode);
 		VkShaderModule fragShaderModule = createShaderModule(fragShaderIRCode);
+		VkShaderModule depthShaderModule = createShaderModule(depthShaderIRCode);
 
 		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
 		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1146,10 +2284,12 @@ struct Renderer {
 		fragShaderStageInfo.module = fragShaderModule;
 		fragShaderStageInfo.pName = "main";
 
-		VkPipelineShaderStageCreateInfo shaderStages[] = {
-			vertShaderStageInfo,
-			fragShaderStageInfo
-		};
+		// the depth prepass's only stage
+		VkPipelineShaderStageCreateInfo depthShaderStageInfo{};
+		depthShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		depthShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+		depthShaderStageInfo.module = depthShaderModule;
+		depthShaderStageInfo.pName = "main";
 
 		auto bindingDescription = Vertex::getBindingDescription();
 		auto attributeDescriptions = Vertex::getAttributeDescriptions();
@@ -1163,44 +2303,40 @@ struct Renderer {
 				static_cast<uint32_t>(attributeDescriptions.size());
 		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
+		// the depth prepass reads the geometry pool's position buffer instead
+		auto positionBindingDescription = Vertex::getPositionBindingDescription();
+		auto positionAttributeDescription = Vertex::getPositionAttributeDescription();
+
+		VkPipelineVertexInputStateCreateInfo positionInputInfo{};
+		positionInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		positionInputInfo.vertexBindingDescriptionCount = 1;
+		positionInputInfo.pVertexBindingDescriptions = &positionBindingDescription;
+		positionInputInfo.vertexAttributeDescriptionCount = 1;
+		positionInputInfo.pVertexAttributeDescriptions = &positionAttributeDescription;
+
 		// set up input assembly, which describes what kind of geometry will be
-		// drawn from the vertices (topology), and if the primitive restart should
-		// be enabled
+		// drawn from the vertices (topology, which comes from the description), and
+		// if the primitive restart should be enabled
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
 		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-		// set up viewport
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)swapChainExtent_.width;
-		viewport.height = (float)swapChainExtent_.height;
-		viewport.minDepth = 0.0f; // standard values
-		viewport.maxDepth = 1.0f;
-
-		// scissors are used for filtering areas out of the framebuffer
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent_;
-
+		// viewport and scissor are dynamic state, set in recordCommandBuffer(), so
+		// only their counts are baked into the pipeline
 		VkPipelineViewportStateCreateInfo viewportState{};
 		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
+		viewportState.pViewports = nullptr; // ignored, dynamic state
 		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
+		viewportState.pScissors = nullptr; // ignored, dynamic state
 
-		// set up rasterizer
+		// set up rasterizer (polygon mode, culling and front face come from the
+		// description)
 		VkPipelineRasterizationStateCreateInfo rasterizer{};
 		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 		rasterizer.depthClampEnable = VK_FALSE;
 		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL; // LINE or POINT requires enabling a GPU feature
 		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT; // cull back faces
-		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE; // specify vertex order for faces to be considered front faces
 		rasterizer.depthBiasEnable = VK_FALSE; // depth biasing is sometimes used for shadow mapping
 		rasterizer.depthBiasConstantFactor = 1.0f; // optional
 		rasterizer.depthBiasClamp = 0.0f; // optional
@@ -1217,16 +2353,14 @@ struct Renderer {
 		multisampling.alphaToCoverageEnable = VK_FALSE; // optional
 		multisampling.alphaToOneEnable = VK_FALSE; // optional
 
+		// depth test, write and compare op come from the description
 		VkPipelineDepthStencilStateCreateInfo depthStencil{};
 		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-		depthStencil.depthTestEnable = VK_TRUE; // test new fragments against depth buffer
-		depthStencil.depthWriteEnable = VK_TRUE; // new fragments that pass the depth test get written to the depth buffer
-		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS; // lower depth == closer
 		depthStencil.stencilTestEnable = VK_FALSE; // disable stencil buffer operations
 		depthStencil.front = {}; // optional
 		depthStencil.back = {}; // optional
 
-		// set up color blending (entirely disabled)
+		// set up color blending (disabled unless the description asks for it)
 		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
 		colorBlendAttachment.colorWriteMask =
 				VK_COLOR_COMPONENT_R_BIT |
@@ -1246,63 +2380,244 @@ struct Renderer {
 		colorBlending.logicOpEnable = VK_FALSE;
 		colorBlending.logicOp = VK_LOGIC_OP_COPY; // optional
 		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
 		colorBlending.blendConstants[0] = 0.0f; // optional
 		colorBlending.blendConstants[1] = 0.0f; // optional
 		colorBlending.blendConstants[2] = 0.0f; // optional
 		colorBlending.blendConstants[3] = 0.0f; // optional
 
-		// not setting up dynamic state (VkDynamicState)
-
-		// set up pipeline layout (empty for now)
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1;
-		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
-		pipelineLayoutInfo.pushConstantRangeCount = 0; // optional
-		pipelineLayoutInfo.pPushConstantRanges = nullptr; // optional
+		// dynamic state is set while recording the command buffer instead of being
+		// baked into the pipeline, so the pipeline doesn't need to be recreated
+		// when the window is resized
+		std::vector<VkDynamicState> dynamicStates = {
+			VK_DYNAMIC_STATE_VIEWPORT,
+			VK_DYNAMIC_STATE_SCISSOR
+		};
 
-		if (
-				vkCreatePipelineLayout(
-						logicalDevice_,
-						&pipelineLayoutInfo,
-						nullptr,
-						&pipelineLayout_) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create pipeline layout");
+		if (extendedDynamicStateSupported_) {
+			dynamicStates.push_back(VK_DYNAMIC_STATE_CULL_MODE_EXT);
+			dynamicStates.push_back(VK_DYNAMIC_STATE_FRONT_FACE_EXT);
+			dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT);
+			dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT);
+			dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT);
 		}
 
-		// finally, set up the pipeline itself
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStages;
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pDepthStencilState = &depthStencil;
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = nullptr; // optional
-		pipelineInfo.layout = pipelineLayout_;
-		pipelineInfo.renderPass = renderPass_;
-		pipelineInfo.subpass = 0;
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // optional, not deriving from an existing pipeline
-		pipelineInfo.basePipelineIndex = -1; // optional
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
+
+		// the parts of the create info that come from the description
+		struct DescribedState {
+			std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+			uint32_t shaderStageCount;
+			VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+			VkPipelineRasterizationStateCreateInfo rasterizer;
+			VkPipelineDepthStencilStateCreateInfo depthStencil;
+			VkPipelineColorBlendAttachmentState colorBlendAttachment;
+			VkPipelineColorBlendStateCreateInfo colorBlending;
+		};
 
-		if (
-				vkCreateGraphicsPipelines(
-						logicalDevice_,
-						VK_NULL_HANDLE, // optional VkPipelineCache
-						1, // number of pipelines to create
-						&pipelineInfo,
-						nullptr,
-						&graphicsPipeline_) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create graphics pipeline");
+		// the create infos point into these, so they live in deques, which never
+		// move their elements
+		std::deque<ShaderSpecialization> specializations;
+		std::deque<DescribedState> describedStates;
+		std::vector<VkGraphicsPipelineCreateInfo> pipelineInfos;
+
+		for (const PipelineDescription& description : descriptions) {
+			// feature toggles only affect the fragment shader
+			specializations.emplace_back(
+					description.shaderPermutation, textureTableSize_);
+
+			DescribedState& state = describedStates.emplace_back();
+			state.shaderStages = { vertShaderStageInfo, fragShaderStageInfo };
+			state.shaderStages[1].pSpecializationInfo = &specializations.back().info;
+			state.shaderStageCount = 2;
+
+			// without a fragment shader, whatever would be written to the color
+			// attachment is undefined, so nothing is
+			if (description.depthOnly) {
+				state.shaderStages = { depthShaderStageInfo, {} };
+				state.shaderStageCount = 1;
+			}
+
+			state.inputAssembly = inputAssembly;
+			state.inputAssembly.topology = description.topology;
+
+			// culling, front face and depth state are ignored with extended dynamic
+			// state, and set in the command buffer instead
+			state.rasterizer = rasterizer;
+			state.rasterizer.polygonMode = description.polygonMode;
+			state.rasterizer.cullMode = description.rasterState.cullMode;
+			state.rasterizer.frontFace = description.rasterState.frontFace;
+
+			state.depthStencil = depthStencil;
+			state.depthStencil.depthTestEnable = description.rasterState.depthTestEnable;
+			state.depthStencil.depthWriteEnable = description.rasterState.depthWriteEnable;
+			state.depthStencil.depthCompareOp = description.rasterState.depthCompareOp;
+
+			state.colorBlendAttachment = colorBlendAttachment;
+
+			if (description.depthOnly) {
+				state.colorBlendAttachment.colorWriteMask = 0;
+			}
+
+			if (description.blendEnable) {
+				// finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor
+				state.colorBlendAttachment.blendEnable = VK_TRUE;
+				state.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+				state.colorBlendAttachment.dstColorBlendFactor =
+						VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			}
+
+			state.colorBlending = colorBlending;
+			state.colorBlending.pAttachments = &state.colorBlendAttachment;
+
+			// finally, set up the pipeline itself
+			VkGraphicsPipelineCreateInfo pipelineInfo{};
+			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pipelineInfo.stageCount = state.shaderStageCount;
+			pipelineInfo.pStages = state.shaderStages.data();
+			pipelineInfo.pVertexInputState =
+					description.depthOnly ? &positionInputInfo : &vertexInputInfo;
+			pipelineInfo.pInputAssemblyState = &state.inputAssembly;
+			pipelineInfo.pViewportState = &viewportState;
+			pipelineInfo.pRasterizationState = &state.rasterizer;
+			pipelineInfo.pMultisampleState = &multisampling;
+			pipelineInfo.pDepthStencilState = &state.depthStencil;
+			pipelineInfo.pColorBlendState = &state.colorBlending;
+			pipelineInfo.pDynamicState = &dynamicState;
+			pipelineInfo.layout = pipelineLayout_;
+			pipelineInfo.renderPass = renderPass;
+			pipelineInfo.subpass = 0;
+			pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // optional, not deriving from an existing pipeline
+			pipelineInfo.basePipelineIndex = -1; // optional
+
+			pipelineInfos.push_back(pipelineInfo);
 		}
 
+		std::vector<VkPipeline> pipelines(pipelineInfos.size(), VK_NULL_HANDLE);
+
+		auto pipelineCreationStart = std::chrono::steady_clock::now();
+
+		// creating every variant in one call lets the driver share work between
+		// them, and the pipeline cache dedupes anything built before
+		VkResult pipelineResult = vkCreateGraphicsPipelines(
+				logicalDevice_,
+				pipelineCache_, // reuses compiled pipeline state from earlier runs
+				static_cast<uint32_t>(pipelineInfos.size()),
+				pipelineInfos.data(),
+				nullptr,
+				pipelines.data());
+
+		// shader modules are only needed during pipeline creation
+		vkDestroyShaderModule(logicalDevice_, depthShaderModule, nullptr);
 		vkDestroyShaderModule(logicalDevice_, fragShaderModule, nullptr);
 		vkDestroyShaderModule(logicalDevice_, vertShaderModule, nullptr);
+
+		if (pipelineResult != VK_SUCCESS) {
+			// some of the pipelines may have been created anyways
+			for (VkPipeline pipeline : pipelines) {
+				vkDestroyPipeline(logicalDevice_, pipeline, nullptr);
+			}
+
+			throw std::runtime_error("failed to create graphics pipeline");
+		}
+
+		GraphicsPipelines result;
+
+		for (size_t i = 0; i < descriptions.size(); i++) {
+			GraphicsPipeline& pipeline = result[descriptions[i]];
+			pipeline.pipeline = pipelines[i];
+			pipeline.layout = pipelineLayout_;
+			pipeline.renderPass = renderPass;
+			pipeline.shaderFiles = shaderFiles;
+		}
+
+		auto pipelineCreationTime =
+				std::chrono::duration<double, std::milli>(
+						std::chrono::steady_clock::now() - pipelineCreationStart);
+
+		// the first pipelines are the interesting ones, after that the cache will
+		// always be warm from this run
+		std::cout << "created " << result.size() << " graphics pipeline(s) in " <<
+				pipelineCreationTime.count() << " ms (" <<
+				(pipelineCacheWarm_ ? "warm" : "cold") << " pipeline cache)\n";
+
+		for (const PipelineDescription& description : descriptions) {
+			if (description.depthOnly) {
+				std::cout << "  depth prepass\n";
+				continue;
+			}
+
+			std::cout << "  shader permutation: " <<
+					describeShaderPermutation(description.shaderPermutation) << std::endl;
+		}
+
+		return result;
+	}
+
+	// **************************************************************************
+	// * Pipeline State Cache
+	// **************************************************************************
+
+	// materials and passes ask for pipelines by description, and get the cached
+	// pipeline when there is one
+	// a miss builds the pipeline right away, which stalls the frame, so misses
+	// after startup mean getScenePipelineDescriptions() is missing something
+	const GraphicsPipeline& getGraphicsPipeline(
+			const PipelineDescription& description) {
+		PipelineDescription key = this->normalizePipelineDescription(description);
+		auto cached = graphicsPipelines_.find(key);
+
+		if (cached != graphicsPipelines_.end()) {
+			pipelineCacheHits_++;
+			return cached->second;
+		}
+
+		pipelineCacheMisses_++;
+		std::cout << "pipeline cache miss, building a new pipeline\n";
+
+		GraphicsPipelines built = this->buildGraphicsPipelines(renderPass_, { key });
+
+		// references to unordered_map elements survive rehashing
+		return graphicsPipelines_.emplace(key, built.begin()->second).first->second;
+	}
+
+	// state that's set dynamically doesn't need separate pipelines, so it's left
+	// out of the key
+	PipelineDescription normalizePipelineDescription(
+			const PipelineDescription& description) {
+		PipelineDescription key = description;
+
+		if (extendedDynamicStateSupported_) {
+			key.rasterState = RasterState{};
+		}
+
+		// shader permutations are fragment shader toggles, and there's no
+		// fragment shader to toggle
+		if (key.depthOnly) {
+			key.shaderPermutation = kDefaultShaderPermutation;
+		}
+
+		return key;
+	}
+
+	// reports pipeline cache activity about once a second, so pipeline churn
+	// shows up next to the FPS
+	void maybeLogPipelineCacheStats() {
+		auto now = std::chrono::steady_clock::now();
+
+		if (now - lastPipelineCacheStatsTime_ < std::chrono::seconds(1)) {
+			return;
+		}
+
+		std::cout << "pipeline cache: " << pipelineCacheHits_ << " hits, " <<
+				pipelineCacheMisses_ << " misses, " << graphicsPipelines_.size() <<
+				" pipelines\n";
+
+		lastPipelineCacheStatsTime_ = now;
+		pipelineCacheHits_ = 0;
+		pipelineCacheMisses_ = 0;
 	}
 
 	VkShaderModule createShaderModule(const std::vector<char>& spirVCode) {
@@ -1366,7 +2681,7 @@ struct Renderer {
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		poolInfo.flags = 0; // optional
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // command buffers are reset and re-recorded every frame
 
 		if (
 				vkCreateCommandPool(
@@ -1442,12 +2757,15 @@ struct Renderer {
 	}
 
 	void copyBuffer(
-			VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize) {
+			VkBuffer srcBuffer,
+			VkBuffer dstBuffer,
+			VkDeviceSize bufferSize,
+			VkDeviceSize dstOffset = 0) {
 		VkCommandBuffer tempCommandBuffer = this->createSingleUseTempCommandBuffer();
 
 		VkBufferCopy copyRegion{};
 		copyRegion.srcOffset = 0; // optional
-		copyRegion.dstOffset = 0; // optional
+		copyRegion.dstOffset = dstOffset; // where in the destination to copy to
 		copyRegion.size = bufferSize;
 
 		vkCmdCopyBuffer(tempCommandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
@@ -1455,66 +2773,100 @@ struct Renderer {
 		this->endSingleUseTempCommandBuffer(tempCommandBuffer);
 	}
 
-	void createVertexBuffer() {
-		// set up the staging buffer
-		VkDeviceSize bufferSize = sizeof(model_->vertices[0]) * model_->vertices.size();
-		VkBufferUsageFlags stagingBufferUsageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		VkMemoryPropertyFlags stagingBufferDesiredMemoryProperties =
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | // we want memory we can map so we can write it from the CPU
-				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT; // use a memory heap that is host coherent, to avoid inconsistency between the mapped and allocated memory
+	// every mesh is suballocated from one shared pair of vertex and index
+	// buffers (see geometry_pool.h), so they're bound once per frame no matter
+	// how many meshes get drawn
+	void createGeometryPool() {
+		geometryPool_.vertexAllocator_ = FreeListAllocator(kGeometryPoolVertexCapacity);
+		geometryPool_.indexAllocator_ = FreeListAllocator(kGeometryPoolIndexCapacity);
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
+		this->createBufferAndAllocateMemory(
+				kGeometryPoolVertexCapacity * sizeof(Vertex),
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, // we want memory that is only accessible from the device (can't be mapped)
+				geometryPool_.vertexBuffer_,
+				geometryPool_.vertexBufferMemory_);
 
+		// positions again, for the depth prepass, at the same vertex offsets
 		this->createBufferAndAllocateMemory(
-				bufferSize,
-				stagingBufferUsageFlags,
-				stagingBufferDesiredMemoryProperties,
-				stagingBuffer,
-				stagingBufferMemory);
+				kGeometryPoolVertexCapacity * sizeof(glm::vec3),
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				geometryPool_.positionBuffer_,
+				geometryPool_.positionBufferMemory_);
 
-		// copy vertex data to the staging buffer
-		void* vertexData;
+		this->createBufferAndAllocateMemory(
+				kGeometryPoolIndexCapacity * sizeof(uint32_t),
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				geometryPool_.indexBuffer_,
+				geometryPool_.indexBufferMemory_);
 
-		vkMapMemory( // access a region of the specified memory resource as defined by an offset and size
-				logicalDevice_,
-				stagingBufferMemory,
-				0, // offset
-				bufferSize, // size
-				0, // flags
-				&vertexData);
+		for (const Model* model : scene_->meshes_) {
+			meshRanges_.push_back(this->uploadMesh(*model));
+		}
 
-		memcpy(vertexData, model_->vertices.data(), (size_t)bufferSize);
+		std::cout << "geometry pool: " <<
+				geometryPool_.vertexAllocator_.getUsedSize() << " of " <<
+				kGeometryPoolVertexCapacity << " vertices, " <<
+				geometryPool_.indexAllocator_.getUsedSize() << " of " <<
+				kGeometryPoolIndexCapacity << " indices used\n\n";
+	}
 
-		vkUnmapMemory(logicalDevice_, stagingBufferMemory);
+	// indices stay relative to the mesh, and vertexOffset in the draw call
+	// moves them to where the mesh's vertices ended up
+	MeshRange uploadMesh(const Model& model) {
+		std::optional<MeshRange> range = geometryPool_.allocate(
+				static_cast<uint32_t>(model.vertices.size()),
+				static_cast<uint32_t>(model.indices.size()));
 
-		// set up the vertex buffer
-		VkBufferUsageFlags vertexBufferUsageFlags =
-				VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-		VkMemoryPropertyFlags vertexBufferDesiredMemoryProperties =
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT; // we want memory that is only accessible from the device (can't be mapped)
+		if (!range) {
+			throw std::runtime_error("geometry pool is full");
+		}
 
-		this->createBufferAndAllocateMemory(
-				bufferSize,
-				vertexBufferUsageFlags,
-				vertexBufferDesiredMemoryProperties,
-				vertexBuffer_,
-				vertexBufferMemory_);
+		this->uploadToBuffer(
+				model.vertices.data(),
+				sizeof(model.vertices[0]) * model.vertices.size(),
+				geometryPool_.vertexBuffer_,
+				range->firstVertex * sizeof(Vertex));
 
-		this->copyBuffer(stagingBuffer, vertexBuffer_, bufferSize);
+		std::vector<glm::vec3> positions;
+		positions.reserve(model.vertices.size());
 
-		// clean up staging buffer
-		vkDestroyBuffer(logicalDevice_, stagingBuffer, nullptr);
-		vkFreeMemory(logicalDevice_, stagingBufferMemory, nullptr);
+		for (const Vertex& vertex : model.vertices) {
+			positions.push_back(vertex.pos);
+		}
+
+		this->uploadToBuffer(
+				positions.data(),
+				sizeof(positions[0]) * positions.size(),
+				geometryPool_.positionBuffer_,
+				range->firstVertex * sizeof(glm::vec3));
+
+		this->uploadToBuffer(
+				model.indices.data(),
+				sizeof(model.indices[0]) * model.indices.size(),
+				geometryPool_.indexBuffer_,
+				range->firstIndex * sizeof(uint32_t));
+
+		return *range;
 	}
 
-	void createIndexBuffer() {
-		VkDeviceSize bufferSize = sizeof(model_->indices[0]) * model_->indices.size();
+	// copies data into part of a device local buffer, through a staging buffer
+	void uploadToBuffer(
+			const void* data,
+			VkDeviceSize bufferSize,
+			VkBuffer dstBuffer,
+			VkDeviceSize dstOffset) {
+		if (bufferSize == 0) {
+			return;
+		}
+
+		// set up the staging buffer
 		VkBufferUsageFlags stagingBufferUsageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 		VkMemoryPropertyFlags stagingBufferDesiredMemoryProperties =
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | // we want memory we can map so we can write it from the CPU
+				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT; // use a memory heap that is host coherent, to avoid inconsistency between the mapped and allocated memory
 
 		VkBuffer stagingBuffer;
 		VkDeviceMemory stagingBufferMemory;
@@ -1526,54 +2878,39 @@ struct Renderer {
 				stagingBuffer,
 				stagingBufferMemory);
 
-		// copy index data to the staging buffer
-		void* indexData;
+		// copy the data to the staging buffer
+		void* stagingData;
 
-		vkMapMemory(
+		vkMapMemory( // access a region of the specified memory resource as defined by an offset and size
 				logicalDevice_,
 				stagingBufferMemory,
 				0, // offset
 				bufferSize, // size
 				0, // flags
-				&indexData);
+				&stagingData);
 
-		memcpy(indexData, model_->indices.data(), (size_t)bufferSize);
+		memcpy(stagingData, data, (size_t)bufferSize);
 
 		vkUnmapMemory(logicalDevice_, stagingBufferMemory);
 
-		// set up the index buffer
-		VkBufferUsageFlags indexBufferUsageFlags =
-				VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-				VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-		VkMemoryPropertyFlags indexBufferDesiredMemoryProperties =
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT; // we want memory that is only accessible from the device (can't be mapped)
-
-		this->createBufferAndAllocateMemory(
-				bufferSize,
-				indexBufferUsageFlags,
-				indexBufferDesiredMemoryProperties,
-				indexBuffer_,
-				indexBufferMemory_);
-
-		this->copyBuffer(stagingBuffer, indexBuffer_, bufferSize);
+		this->copyBuffer(stagingBuffer, dstBuffer, bufferSize, dstOffset);
 
 		// clean up staging buffer
 		vkDestroyBuffer(logicalDevice_, stagingBuffer, nullptr);
 		vkFreeMemory(logicalDevice_, stagingBufferMemory, nullptr);
 	}
 
+	// one per frame in flight, rather than per swap chain image, since the
+	// frame's fence is what guarantees the GPU is done reading it
 	void createUniformBuffers() {
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+		VkDeviceSize bufferSize = sizeof(FrameUniforms);
 		VkBufferUsageFlags usageFlags =
 				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
 		VkMemoryPropertyFlags desiredMemoryProperties =
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-		uniformBuffers_.resize(swapChainImages_.size());
-		uniformBuffersMemory_.resize(swapChainImages_.size());
-
-		for (size_t i = 0; i < swapChainImages_.size(); i++) {
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 			this->createBufferAndAllocateMemory(
 					bufferSize,
 					usageFlags,
@@ -1583,58 +2920,1075 @@ struct Renderer {
 		}
 	}
 
-	void updateUniformBuffer(uint32_t currentImage) {
-		static auto startTime = std::chrono::high_resolution_clock::now();
+	void updateUniformBuffer(size_t frameIndex) {
+		// per-object transforms go in the instance buffer, see buildDrawBatches()
 
-		// get time elapsed since rendering began
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float time =
-				std::chrono::duration<float, std::chrono::seconds::period>(
-						currentTime - startTime).count();
-
-		UniformBufferObject ubo{};
-
-		// rotate the geometry 15 degrees per second
-		ubo.model =
-				glm::rotate(
-						glm::mat4(1.0f), // existing transformation (in this case, an identity matrix)
-						0.0f, // time * glm::radians(15.0f), // rotation angle
-						glm::vec3(0.0f, 0.0f, 1.0f)); // rotation axis
-
-		// update view based on camera
-		 ubo.view = glm::lookAt(
-		 		camera_->position, camera_->position + camera_->direction, camera_->up);
+		// update view based on camera
+		glm::mat4 view = glm::lookAt(
+				camera_->position, camera_->position + camera_->direction, camera_->up);
 
 		// use a perspective projection with a 45 degree vertical field of view
-		ubo.projection =
+		float zNear = 0.1f;
+		glm::mat4 projection =
 				glm::perspective(
 						glm::radians(45.0f), // field of view
 						swapChainExtent_.width / (float)swapChainExtent_.height, // aspect ratio, in terms of swapchain extent to take into account window resizing
-						0.1f, // near view plane
-						10.0f); // far view plane
+						zNear, // near view plane
+						100.0f); // far view plane, far enough for a grid of models
 
 		// y origin of the clip coordinates is inverted (due to OpenGL
 		// compatibility), so we flip the sign of the y axis on the projection
 		// matrix (otherwise the image will be rendered upside down)
-		ubo.projection[1][1] *= -1;
+		projection[1][1] *= -1;
+
+		FrameUniforms ubo{};
+		ubo.viewProjection = projection * view;
+
+		// culling for this frame uses the same camera the shaders will
+		viewProjection_ = ubo.viewProjection;
+		frustum_ = Frustum::fromViewProjection(ubo.viewProjection);
+
+		if (gpuCullingEnabled_) {
+			this->updateCullUniforms(frameIndex, view, projection, zNear);
+		}
 
 		void* uniformData;
 		vkMapMemory(
 				logicalDevice_,
-				uniformBuffersMemory_[currentImage],
+				uniformBuffersMemory_[frameIndex],
 				0,
 				sizeof(ubo),
 				0,
 				&uniformData);
 		memcpy(uniformData, &ubo, sizeof(ubo));
-		vkUnmapMemory(logicalDevice_, uniformBuffersMemory_[currentImage]);
+		vkUnmapMemory(logicalDevice_, uniformBuffersMemory_[frameIndex]);
+	}
+
+	// **************************************************************************
+	// * Instance Buffers
+	// **************************************************************************
+
+	// like the uniform buffers, there's one per frame in flight, so the CPU can
+	// write the next frame's instances while the GPU reads the last one's
+	void createInstanceBuffers() {
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			this->createInstanceBuffer(i, kInitialInstanceCapacity);
+		}
+	}
+
+	void createInstanceBuffer(size_t frameIndex, uint32_t capacity) {
+		this->createBufferAndAllocateMemory(
+				capacity * sizeof(InstanceData),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				instanceBuffers_[frameIndex],
+				instanceBuffersMemory_[frameIndex]);
+
+		// written every frame, so it stays mapped
+		vkMapMemory(
+				logicalDevice_,
+				instanceBuffersMemory_[frameIndex],
+				0,
+				capacity * sizeof(InstanceData),
+				0,
+				&instanceBuffersMapped_[frameIndex]);
+
+		instanceBufferCapacities_[frameIndex] = capacity;
+
+		if (!batchedIndirectDrawsEnabled_) {
+			return;
+		}
+
+		// every batch has at least one instance, so there are never more
+		// commands than instances
+		this->createBufferAndAllocateMemory(
+				capacity * sizeof(VkDrawIndexedIndirectCommand),
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				indirectBuffers_[frameIndex],
+				indirectBuffersMemory_[frameIndex]);
+
+		vkMapMemory(
+				logicalDevice_,
+				indirectBuffersMemory_[frameIndex],
+				0,
+				capacity * sizeof(VkDrawIndexedIndirectCommand),
+				0,
+				&indirectBuffersMapped_[frameIndex]);
+	}
+
+	// the old buffer may still be in use by an earlier frame, so it goes on the
+	// deletion queue
+	void reserveInstanceBuffer(size_t frameIndex, uint32_t instanceCount) {
+		if (instanceCount <= instanceBufferCapacities_[frameIndex]) {
+			return;
+		}
+
+		uint32_t capacity = instanceBufferCapacities_[frameIndex];
+
+		while (capacity < instanceCount) {
+			capacity *= 2;
+		}
+
+		this->deferDestroyBuffer(
+				instanceBuffers_[frameIndex], instanceBuffersMemory_[frameIndex]);
+
+		if (batchedIndirectDrawsEnabled_) {
+			this->deferDestroyBuffer(
+					indirectBuffers_[frameIndex], indirectBuffersMemory_[frameIndex]);
+		}
+
+		this->createInstanceBuffer(frameIndex, capacity);
+	}
+
+	// culls the scene's renderables, sorts what's left by draw key, and writes
+	// their instance data in that order, so renderables with the same mesh and
+	// material are a single instanced draw
+	// sorting by pipeline first means pipeline changes are rare
+	void buildDrawBatches(size_t frameIndex) {
+		uint32_t renderableCount =
+				static_cast<uint32_t>(scene_->getRenderableCount());
+
+		this->reserveInstanceBuffer(frameIndex, renderableCount);
+
+		// cull against the world space bounding spheres, then the sort only
+		// touches what's left
+		renderableVisibility_.resize(renderableCount);
+
+		if (renderableCount >= kBvhCullingMinRenderables) {
+			this->cullRenderablesWithBvh();
+		} else {
+			drawnRenderableCount_ = frustum_.cullSpheres(
+					scene_->boundsCenterX_.data(),
+					scene_->boundsCenterY_.data(),
+					scene_->boundsCenterZ_.data(),
+					scene_->boundsRadius_.data(),
+					renderableCount,
+					renderableVisibility_.data());
+		}
+
+		culledRenderableCount_ = renderableCount - drawnRenderableCount_;
+
+		// a precomputed visible set, where there is one, already knows what's
+		// hidden from here, so there's nothing to rasterize
+		const Pvs* pvs = scene_->getPvs();
+		pvsCell_ = pvs != nullptr ? pvs->findCell(camera_->position) : Pvs::kNoCell;
+
+		if (pvsCell_ != Pvs::kNoCell) {
+			this->cullRenderablesWithPvs(*pvs, renderableCount);
+		} else if (softwareOcclusionEnabled_) {
+			this->cullOccludedRenderables(renderableCount);
+		} else {
+			occludedRenderableCount_ = 0;
+		}
+
+		const std::vector<MeshId>& meshIds = scene_->meshIds_;
+		const std::vector<MaterialId>& materialIds = scene_->materialIds_;
+
+		this->buildMaterialDrawKeys();
+
+		drawKeys_.clear();
+
+		for (RenderableId id = 0; id < renderableCount; id++) {
+			if (!renderableVisibility_[id]) {
+				continue;
+			}
+
+			uint64_t key = materialDrawKeys_[materialIds[id]] |
+					(meshIds[id] & kDrawKeyMeshMask) << kDrawKeyMeshShift |
+					this->getDepthKey(id);
+
+			drawKeys_.push_back({ key, id });
+		}
+
+		radixSorter_.sort(drawKeys_, workerPool_);
+
+		InstanceData* instances =
+				static_cast<InstanceData*>(instanceBuffersMapped_[frameIndex]);
+		drawBatches_.clear();
+
+		for (uint32_t i = 0; i < drawnRenderableCount_; i++) {
+			RenderableId id = drawKeys_[i].value;
+			instances[i].model = scene_->transforms_[id];
+			instances[i].textureIndex = materialTextureIndices_[materialIds[id]];
+
+			if (
+					drawBatches_.empty() ||
+					drawBatches_.back().meshId != meshIds[id] ||
+					drawBatches_.back().materialId != materialIds[id]) {
+				drawBatches_.push_back({
+					meshIds[id],
+					materialIds[id],
+					i,
+					0,
+					drawKeys_[i].key & kDrawKeyDepthMask
+				});
+			}
+
+			drawBatches_.back().instanceCount++;
+		}
+
+		// instances are already in depth order within each batch, and nothing
+		// but the pipeline has to be bound between batches (the texture index is
+		// per instance), so batches can be put in depth order too, as long as
+		// each pipeline's batches stay together
+		// a batch sorts by its first instance, which is its nearest
+		auto runBegin = drawBatches_.begin();
+
+		while (runBegin != drawBatches_.end()) {
+			VkPipeline pipeline = materialPipelines_[runBegin->materialId];
+			auto runEnd = std::find_if(
+					runBegin,
+					drawBatches_.end(),
+					[&](const DrawBatch& batch) {
+						return materialPipelines_[batch.materialId] != pipeline;
+					});
+
+			std::stable_sort(
+					runBegin,
+					runEnd,
+					[](const DrawBatch& a, const DrawBatch& b) {
+						return a.depthKey < b.depthKey;
+					});
+
+			runBegin = runEnd;
+		}
+
+		if (batchedIndirectDrawsEnabled_) {
+			this->buildIndirectDrawGroups(frameIndex);
+		}
+	}
+
+	// only visits the parts of the scene near the frustum, so the cost grows
+	// with what's visible rather than with the whole scene
+	// the BVH tests boxes around the bounding spheres, which lets a few more
+	// renderables through near the frustum's edges than the sphere test does
+	void cullRenderablesWithBvh() {
+		scene_->updateBvh(&workerPool_);
+
+		bvhVisibleRenderables_.clear();
+		scene_->bvh_.cullFrustum(frustum_, bvhVisibleRenderables_);
+
+		std::fill(renderableVisibility_.begin(), renderableVisibility_.end(), 0);
+
+		for (RenderableId id : bvhVisibleRenderables_) {
+			renderableVisibility_[id] = 1;
+		}
+
+		drawnRenderableCount_ = static_cast<uint32_t>(bvhVisibleRenderables_.size());
+	}
+
+	// the pipeline and material bits of each material's draw keys
+	// pipelines are numbered in order of first use, so materials that share
+	// one get the same pipeline bits and end up next to each other, which lets
+	// them share an indirect call
+	void buildMaterialDrawKeys() {
+		size_t materialCount = scene_->materials_.size();
+		materialPipelines_.resize(materialCount);
+		materialDrawKeys_.resize(materialCount);
+
+		std::vector<VkPipeline> pipelines;
+
+		for (MaterialId id = 0; id < materialCount; id++) {
+			PipelineDescription description =
+					this->getMaterialPipelineDescription(id, depthPrepassEnabled_);
+			VkPipeline pipeline = this->getGraphicsPipeline(description).pipeline;
+			materialPipelines_[id] = pipeline;
+
+			// only a handful of pipelines, so a linear search is fine
+			uint64_t pipelineIndex =
+					std::find(pipelines.begin(), pipelines.end(), pipeline) -
+					pipelines.begin();
+
+			if (pipelineIndex == pipelines.size()) {
+				pipelines.push_back(pipeline);
+			}
+
+			materialDrawKeys_[id] =
+					(pipelineIndex & kDrawKeyPipelineMask) << kDrawKeyPipelineShift |
+					(id & kDrawKeyMaterialMask) << kDrawKeyMaterialShift;
+		}
+	}
+
+	// the renderable's distance in front of the camera, as the depth bits of
+	// its draw key
+	// that's clip space w, which is never negative for anything that passed
+	// frustum culling, and the bits of a positive float sort like the float,
+	// so dropping the sign bit and the low mantissa bits keeps the order
+	uint64_t getDepthKey(RenderableId id) {
+		glm::vec4 center(
+				scene_->boundsCenterX_[id],
+				scene_->boundsCenterY_[id],
+				scene_->boundsCenterZ_[id],
+				1.0f);
+		float distance = (viewProjection_ * center).w;
+
+		// the bounds can reach in front of the camera with the center behind it
+		if (!(distance > 0.0f)) {
+			return 0;
+		}
+
+		uint32_t bits;
+		std::memcpy(&bits, &distance, sizeof(bits));
+
+		return (bits >> 11) & kDrawKeyDepthMask;
+	}
+
+	// writes a command per batch to the frame's indirect buffer, and splits
+	// them into runs that share a pipeline, so recording costs one call per
+	// pipeline instead of one per batch
+	void buildIndirectDrawGroups(size_t frameIndex) {
+		VkDrawIndexedIndirectCommand* commands =
+				static_cast<VkDrawIndexedIndirectCommand*>(indirectBuffersMapped_[frameIndex]);
+		indirectDrawGroups_.clear();
+
+		for (uint32_t i = 0; i < drawBatches_.size(); i++) {
+			const DrawBatch& batch = drawBatches_[i];
+			const MeshRange& mesh = meshRanges_[batch.meshId];
+
+			commands[i].indexCount = mesh.indexCount;
+			commands[i].instanceCount = batch.instanceCount;
+			commands[i].firstIndex = mesh.firstIndex;
+			commands[i].vertexOffset = static_cast<int32_t>(mesh.firstVertex);
+			commands[i].firstInstance = batch.firstInstance; // the vertex shader finds its instances from here
+
+			VkPipeline pipeline = materialPipelines_[batch.materialId];
+
+			if (
+					indirectDrawGroups_.empty() ||
+					indirectDrawGroups_.back().pipeline != pipeline ||
+					indirectDrawGroups_.back().commandCount == maxDrawIndirectCount_) {
+				indirectDrawGroups_.push_back({ batch.materialId, pipeline, i, 0 });
+			}
+
+			indirectDrawGroups_.back().commandCount++;
+		}
+	}
+
+	// **************************************************************************
+	// * Worker Pool
+	// **************************************************************************
+
+	// threads for the CPU culling path's per-frame work, the occlusion
+	// rasterizer and the draw sort
+	// the GPU path doesn't need them, so it runs that work (if any) inline
+	void createWorkerPool() {
+		if (gpuCullingEnabled_) {
+			return;
+		}
+
+		// leave one core for the render thread's own work, which takes a share
+		// of the tasks too while it waits
+		// (hardware_concurrency() can be 0 if it isn't known)
+		uint32_t threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+		workerPool_.init(threadCount);
+
+		std::cout << "worker pool: " << threadCount << " threads\n\n";
+	}
+
+	// **************************************************************************
+	// * Software Occlusion Culling
+	// **************************************************************************
+
+	// only used by the CPU culling path, the GPU path has its own occlusion test
+	void createOcclusionRasterizer() {
+		if (gpuCullingEnabled_ || !kEnableSoftwareOcclusion) {
+			return;
+		}
+
+		occlusionRasterizer_.init(
+				kOcclusionBufferWidth, kOcclusionBufferHeight, &workerPool_);
+		softwareOcclusionEnabled_ = true;
+	}
+
+	// rasterizes the occluders that passed the frustum test, then clears the
+	// visibility of everything whose bounds are entirely behind them
+	// occluders are tested too, since they can hide each other, and one can
+	// never hide itself because its bounds are in front of its own surface
+	void cullOccludedRenderables(uint32_t renderableCount) {
+		occlusionRasterizer_.beginFrame();
+
+		for (RenderableId id = 0; id < renderableCount; id++) {
+			if (!renderableVisibility_[id] || !scene_->occluders_[id]) {
+				continue;
+			}
+
+			const Model* mesh = scene_->meshes_[scene_->meshIds_[id]];
+
+			occlusionRasterizer_.addOccluder(
+					viewProjection_ * scene_->transforms_[id],
+					mesh->vertices,
+					mesh->indices);
+		}
+
+		occludedRenderableCount_ = 0;
+
+		// nothing to hide behind
+		if (occlusionRasterizer_.getTriangleCount() == 0) {
+			return;
+		}
+
+		occlusionRasterizer_.render();
+
+		for (RenderableId id = 0; id < renderableCount; id++) {
+			if (!renderableVisibility_[id]) {
+				continue;
+			}
+
+			glm::vec3 center(
+					scene_->boundsCenterX_[id],
+					scene_->boundsCenterY_[id],
+					scene_->boundsCenterZ_[id]);
+			glm::vec3 extent(scene_->boundsRadius_[id]);
+
+			if (
+					!occlusionRasterizer_.isBoxVisible(
+							center - extent, center + extent, viewProjection_)) {
+				renderableVisibility_[id] = 0;
+				occludedRenderableCount_++;
+			}
+		}
+
+		drawnRenderableCount_ -= occludedRenderableCount_;
+		culledRenderableCount_ += occludedRenderableCount_;
+	}
+
+	// **************************************************************************
+	// * Potentially Visible Set
+	// **************************************************************************
+
+	// clears the visibility of everything that can't be seen from the camera's
+	// cell, which is a bit test per renderable that passed the frustum test
+	// only the CPU culling path looks at the PVS, since the GPU path's occlusion
+	// test is already cheap
+	void cullRenderablesWithPvs(const Pvs& pvs, uint32_t renderableCount) {
+		const uint64_t* visibleBits = pvs.getVisibleBits(pvsCell_);
+
+		occludedRenderableCount_ = 0;
+
+		for (RenderableId id = 0; id < renderableCount; id++) {
+			if (renderableVisibility_[id] && !((visibleBits[id / 64] >> (id % 64)) & 1)) {
+				renderableVisibility_[id] = 0;
+				occludedRenderableCount_++;
+			}
+		}
+
+		drawnRenderableCount_ -= occludedRenderableCount_;
+		culledRenderableCount_ += occludedRenderableCount_;
+	}
+
+	// **************************************************************************
+	// * GPU Culling
+	// **************************************************************************
+
+	// compute pipelines for culling and for building the depth pyramid, each
+	// with its own layout, since they share nothing with the graphics pipelines
+	// besides the buffers
+	void createCullPipeline() {
+		if (!gpuCullingEnabled_) {
+			return;
+		}
+
+		// objects, commands, draw counts, visibility, depth pyramid, uniforms
+		std::vector<VkDescriptorSetLayoutBinding> bindings(6);
+
+		for (uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			bindings[i].pImmutableSamplers = nullptr;
+		}
+
+		bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+		cullDescriptorSetLayout_ = this->createDescriptorSetLayout(bindings);
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullPushConstants);
+
+		cullPipelineLayout_ = this->createComputePipelineLayout(
+				cullDescriptorSetLayout_, &pushConstantRange);
+		cullPipeline_ = this->createComputePipeline("cull.comp", cullPipelineLayout_);
+
+		// the level being read, and the level being written
+		std::vector<VkDescriptorSetLayoutBinding> reduceBindings(2);
+		reduceBindings[0].binding = 0;
+		reduceBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		reduceBindings[0].descriptorCount = 1;
+		reduceBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		reduceBindings[1].binding = 1;
+		reduceBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		reduceBindings[1].descriptorCount = 1;
+		reduceBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		depthReduceDescriptorSetLayout_ =
+				this->createDescriptorSetLayout(reduceBindings);
+		depthReducePipelineLayout_ = this->createComputePipelineLayout(
+				depthReduceDescriptorSetLayout_, nullptr);
+		depthReducePipeline_ = this->createComputePipeline(
+				"depth_reduce.comp", depthReducePipelineLayout_);
+
+		this->createDepthPyramidSampler();
+	}
+
+	VkPipelineLayout createComputePipelineLayout(
+			VkDescriptorSetLayout setLayout,
+			const VkPushConstantRange* pushConstantRange) {
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = pushConstantRange ? 1 : 0;
+		pipelineLayoutInfo.pPushConstantRanges = pushConstantRange;
+
+		VkPipelineLayout pipelineLayout;
+
+		if (
+				vkCreatePipelineLayout(
+						logicalDevice_,
+						&pipelineLayoutInfo,
+						nullptr,
+						&pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute pipeline layout");
+		}
+
+		return pipelineLayout;
+	}
+
+	// shaderName is the file name in the shaders directory
+	VkPipeline createComputePipeline(
+			const std::string& shaderName, VkPipelineLayout pipelineLayout) {
+#if PHALANX_DYNAMIC_SHADER_COMPILATION == 1
+		std::vector<char> shaderIRCode = loadComputeShader("shaders/" + shaderName);
+#else
+		std::vector<char> shaderIRCode = shaderBundle_.getSpirV(shaderName);
+#endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 1
+
+		VkShaderModule shaderModule = this->createShaderModule(shaderIRCode);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = pipelineLayout;
+
+		VkPipeline pipeline;
+		VkResult result = vkCreateComputePipelines(
+				logicalDevice_,
+				pipelineCache_,
+				1,
+				&pipelineInfo,
+				nullptr,
+				&pipeline);
+
+		// the module is only needed to create the pipeline
+		vkDestroyShaderModule(logicalDevice_, shaderModule, nullptr);
+
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute pipeline for " + shaderName);
+		}
+
+		return pipeline;
+	}
+
+	void createCullBuffers() {
+		if (!gpuCullingEnabled_) {
+			return;
+		}
+
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+			this->createCullBuffer(
+					i, kInitialInstanceCapacity, kInitialDrawCountCapacity);
+		}
+
+		this->createVisibilityBuffer(kInitialInstanceCapacity);
+	}
+
+	void createCullBuffer(
+			size_t frameIndex, uint32_t objectCapacity, uint32_t countCapacity) {
+		CullBuffers& buffers = cullBuffers_[frameIndex];
+		buffers = CullBuffers{};
+		buffers.objectCapacity = objectCapacity;
+		buffers.countCapacity = countCapacity;
+
+		VkMemoryPropertyFlags hostVisibleMemoryProperties =
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		// only written when the scene changes, so it stays mapped
+		this->createBufferAndAllocateMemory(
+				objectCapacity * sizeof(CullObject),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				hostVisibleMemoryProperties,
+				buffers.objectBuffer,
+				buffers.objectBufferMemory);
+
+		vkMapMemory(
+				logicalDevice_,
+				buffers.objectBufferMemory,
+				0,
+				objectCapacity * sizeof(CullObject),
+				0,
+				&buffers.objectsMapped);
+
+		// every renderable could be visible, so there's room for one command each
+		this->createBufferAndAllocateMemory(
+				objectCapacity * sizeof(VkDrawIndexedIndirectCommand),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				buffers.commandBuffer,
+				buffers.commandBufferMemory);
+
+		this->createBufferAndAllocateMemory(
+				countCapacity * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+						VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+						VK_BUFFER_USAGE_TRANSFER_SRC_BIT | // copied to the readback buffer
+						VK_BUFFER_USAGE_TRANSFER_DST_BIT, // cleared before each phase
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				buffers.countBuffer,
+				buffers.countBufferMemory);
+
+		// the early phase's counts, then the late phase's
+		VkDeviceSize readbackSize = kCullPhaseCount * countCapacity * sizeof(uint32_t);
+
+		this->createBufferAndAllocateMemory(
+				readbackSize,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				hostVisibleMemoryProperties,
+				buffers.countReadbackBuffer,
+				buffers.countReadbackBufferMemory);
+
+		vkMapMemory(
+				logicalDevice_,
+				buffers.countReadbackBufferMemory,
+				0,
+				readbackSize,
+				0,
+				&buffers.countsReadbackMapped);
+
+		// nothing has been culled into it yet
+		memset(buffers.countsReadbackMapped, 0, readbackSize);
+
+		// written every frame
+		this->createBufferAndAllocateMemory(
+				sizeof(CullUniforms),
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				hostVisibleMemoryProperties,
+				buffers.uniformBuffer,
+				buffers.uniformBufferMemory);
+
+		vkMapMemory(
+				logicalDevice_,
+				buffers.uniformBufferMemory,
+				0,
+				sizeof(CullUniforms),
+				0,
+				&buffers.uniformsMapped);
+	}
+
+	// freeing the memory unmaps it
+	void destroyCullBuffers(const CullBuffers& buffers) {
+		vkDestroyBuffer(logicalDevice_, buffers.objectBuffer, nullptr);
+		vkFreeMemory(logicalDevice_, buffers.objectBufferMemory, nullptr);
+		vkDestroyBuffer(logicalDevice_, buffers.commandBuffer, nullptr);
+		vkFreeMemory(logicalDevice_, buffers.commandBufferMemory, nullptr);
+		vkDestroyBuffer(logicalDevice_, buffers.countBuffer, nullptr);
+		vkFreeMemory(logicalDevice_, buffers.countBufferMemory, nullptr);
+		vkDestroyBuffer(logicalDevice_, buffers.countReadbackBuffer, nullptr);
+		vkFreeMemory(logicalDevice_, buffers.countReadbackBufferMemory, nullptr);
+		vkDestroyBuffer(logicalDevice_, buffers.uniformBuffer, nullptr);
+		vkFreeMemory(logicalDevice_, buffers.uniformBufferMemory, nullptr);
+	}
+
+	// whether each renderable was visible last frame, which carries over from
+	// one frame to the next, so unlike the other cull buffers there's only one
+	// a new buffer starts out with nothing visible, which just means everything
+	// waits for the late phase for a frame
+	void createVisibilityBuffer(uint32_t capacity) {
+		this->createBufferAndAllocateMemory(
+				capacity * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				visibilityBuffer_,
+				visibilityBufferMemory_);
+
+		visibilityBufferCapacity_ = capacity;
+		visibilityBufferNeedsClear_ = true;
+	}
+
+	// the GPU's counts from the last time this frame slot was used, which the
+	// fence wait guarantees are written
+	void readCullingResults(size_t frameIndex) {
+		const CullBuffers& buffers = cullBuffers_[frameIndex];
+		const uint32_t* counts =
+				static_cast<const uint32_t*>(buffers.countsReadbackMapped);
+		uint32_t countCount = std::min(
+				buffers.countCapacity,
+				static_cast<uint32_t>(scene_->materials_.size()));
+
+		drawnRenderableCount_ = 0;
+
+		for (uint32_t phase = 0; phase < kCullPhaseCount; phase++) {
+			for (uint32_t i = 0; i < countCount; i++) {
+				drawnRenderableCount_ += counts[phase * buffers.countCapacity + i];
+			}
+		}
+
+		culledRenderableCount_ = buffers.objectCount - drawnRenderableCount_;
+	}
+
+	// everything the cull shader needs to know about the camera
+	void updateCullUniforms(
+			size_t frameIndex,
+			const glm::mat4& view,
+			const glm::mat4& projection,
+			float zNear) {
+		CullUniforms uniforms{};
+		uniforms.view = view;
+
+		for (int i = 0; i < Frustum::kPlaneCount; i++) {
+			uniforms.frustumPlanes[i] = frustum_.planes[i];
+		}
+
+		uniforms.p00 = projection[0][0];
+		uniforms.p11 = projection[1][1];
+		uniforms.p22 = projection[2][2];
+		uniforms.p32 = projection[3][2];
+		uniforms.zNear = zNear;
+		uniforms.depthWidth = swapChainExtent_.width;
+		uniforms.depthHeight = swapChainExtent_.height;
+		uniforms.pyramidLevelCount = depthPyramidLevelCount_;
+
+		memcpy(cullBuffers_[frameIndex].uniformsMapped, &uniforms, sizeof(uniforms));
+	}
+
+	// uploads the scene's renderables for cull.comp, and their transforms to
+	// the instance buffer in RenderableId order, but only when the scene has
+	// changed since this frame slot last did
+	void updateCullBuffers(size_t frameIndex) {
+		uint64_t sceneRevision = scene_->getRevision();
+		uint32_t renderableCount =
+				static_cast<uint32_t>(scene_->getRenderableCount());
+		uint32_t materialCount = static_cast<uint32_t>(scene_->materials_.size());
+
+		if (cullBuffers_[frameIndex].sceneRevision == sceneRevision) {
+			return;
+		}
+
+		this->reserveInstanceBuffer(frameIndex, renderableCount);
+
+		CullBuffers& oldBuffers = cullBuffers_[frameIndex];
+
+		if (
+				renderableCount > oldBuffers.objectCapacity ||
+				materialCount > oldBuffers.countCapacity) {
+			uint32_t objectCapacity = oldBuffers.objectCapacity;
+			uint32_t countCapacity = oldBuffers.countCapacity;
+
+			while (objectCapacity < renderableCount) {
+				objectCapacity *= 2;
+			}
+
+			while (countCapacity < materialCount) {
+				countCapacity *= 2;
+			}
+
+			// an earlier frame may still be reading them
+			CullBuffers retiredBuffers = oldBuffers;
+			this->deferDestruction([this, retiredBuffers]() {
+				this->destroyCullBuffers(retiredBuffers);
+			});
+
+			this->createCullBuffer(frameIndex, objectCapacity, countCapacity);
+		}
+
+		if (renderableCount > visibilityBufferCapacity_) {
+			uint32_t capacity = visibilityBufferCapacity_;
+
+			while (capacity < renderableCount) {
+				capacity *= 2;
+			}
+
+			this->deferDestroyBuffer(visibilityBuffer_, visibilityBufferMemory_);
+			this->createVisibilityBuffer(capacity);
+		}
+
+		CullBuffers& buffers = cullBuffers_[frameIndex];
+
+		// each material gets a contiguous range of commands, big enough for all of
+		// its renderables
+		materialRenderableCounts_.assign(materialCount, 0);
+		materialCommandOffsets_.assign(materialCount, 0);
+
+		for (uint32_t i = 0; i < renderableCount; i++) {
+			materialRenderableCounts_[scene_->materialIds_[i]]++;
+		}
+
+		for (uint32_t i = 1; i < materialCount; i++) {
+			materialCommandOffsets_[i] =
+					materialCommandOffsets_[i - 1] + materialRenderableCounts_[i - 1];
+		}
+
+		CullObject* objects = static_cast<CullObject*>(buffers.objectsMapped);
+		InstanceData* instances =
+				static_cast<InstanceData*>(instanceBuffersMapped_[frameIndex]);
+
+		for (uint32_t i = 0; i < renderableCount; i++) {
+			const MeshRange& mesh = meshRanges_[scene_->meshIds_[i]];
+			MaterialId materialId = scene_->materialIds_[i];
+
+			CullObject object{};
+			object.sphere = glm::vec4(
+					scene_->boundsCenterX_[i],
+					scene_->boundsCenterY_[i],
+					scene_->boundsCenterZ_[i],
+					scene_->boundsRadius_[i]);
+			object.indexCount = mesh.indexCount;
+			object.firstIndex = mesh.firstIndex;
+			object.vertexOffset = static_cast<int32_t>(mesh.firstVertex);
+			object.materialId = materialId;
+			object.commandOffset = materialCommandOffsets_[materialId];
+
+			objects[i] = object;
+			instances[i].model = scene_->transforms_[i];
+			instances[i].textureIndex = materialTextureIndices_[materialId];
+		}
+
+		buffers.objectCount = renderableCount;
+		buffers.sceneRevision = sceneRevision;
+	}
+
+	// fills the command and count buffers for one phase, see cull.comp
+	void recordCulling(
+			VkCommandBuffer commandBuffer, size_t frameIndex, uint32_t phase) {
+		const CullBuffers& buffers = cullBuffers_[frameIndex];
+		VkDeviceSize countsSize = scene_->materials_.size() * sizeof(uint32_t);
+
+		if (countsSize == 0) {
+			return;
+		}
+
+		// wait for whatever used the buffers last: the early phase's draws and
+		// readback, or for the visibility buffer, the last frame's late phase
+		VkMemoryBarrier reuseBarrier{};
+		reuseBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		reuseBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		reuseBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT |
+				VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+						VK_PIPELINE_STAGE_TRANSFER_BIT |
+						VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				1, &reuseBarrier,
+				0, nullptr,
+				0, nullptr);
+
+		if (visibilityBufferNeedsClear_) {
+			vkCmdFillBuffer(
+					commandBuffer, visibilityBuffer_, 0, VK_WHOLE_SIZE, 0);
+			visibilityBufferNeedsClear_ = false;
+		}
+
+		// every material starts with no draws
+		vkCmdFillBuffer(commandBuffer, buffers.countBuffer, 0, countsSize, 0);
+
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask =
+				VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				1, &clearBarrier,
+				0, nullptr,
+				0, nullptr);
+
+		if (buffers.objectCount > 0) {
+			this->bindCullDescriptors(commandBuffer, frameIndex);
+
+			vkCmdBindPipeline(
+					commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline_);
+
+			CullPushConstants pushConstants{};
+			pushConstants.phase = phase;
+			pushConstants.objectCount = buffers.objectCount;
+
+			vkCmdPushConstants(
+					commandBuffer,
+					cullPipelineLayout_,
+					VK_SHADER_STAGE_COMPUTE_BIT,
+					0, // offset
+					sizeof(pushConstants),
+					&pushConstants);
+
+			vkCmdDispatch(
+					commandBuffer,
+					(buffers.objectCount + kCullWorkgroupSize - 1) / kCullWorkgroupSize,
+					1,
+					1);
+		}
+
+		// the draws read the commands and counts, and the counts are also copied
+		// back for logging
+		VkMemoryBarrier cullBarrier{};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask =
+				VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0,
+				1, &cullBarrier,
+				0, nullptr,
+				0, nullptr);
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = 0;
+		copyRegion.dstOffset = phase * buffers.countCapacity * sizeof(uint32_t);
+		copyRegion.size = countsSize;
+
+		vkCmdCopyBuffer(
+				commandBuffer,
+				buffers.countBuffer,
+				buffers.countReadbackBuffer,
+				1,
+				&copyRegion);
+
+		// make the copy visible to the CPU once the fence signals
+		VkMemoryBarrier readbackBarrier{};
+		readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT,
+				0,
+				1, &readbackBarrier,
+				0, nullptr,
+				0, nullptr);
+	}
+
+	// a transient set, like the frame set without push descriptors
+	void bindCullDescriptors(VkCommandBuffer commandBuffer, size_t frameIndex) {
+		const CullBuffers& buffers = cullBuffers_[frameIndex];
+
+		VkDescriptorSet cullDescriptorSet =
+				frameDescriptorAllocators_[frameIndex].allocate(cullDescriptorSetLayout_);
+
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+		bufferInfos[0].buffer = buffers.objectBuffer;
+		bufferInfos[1].buffer = buffers.commandBuffer;
+		bufferInfos[2].buffer = buffers.countBuffer;
+		bufferInfos[3].buffer = visibilityBuffer_;
+		bufferInfos[4].buffer = buffers.uniformBuffer;
+
+		for (VkDescriptorBufferInfo& bufferInfo : bufferInfos) {
+			bufferInfo.offset = 0;
+			bufferInfo.range = VK_WHOLE_SIZE;
+		}
+
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.sampler = depthPyramidSampler_;
+		pyramidInfo.imageView = depthPyramidView_;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 6> descriptorWrites{};
+
+		for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+			descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[i].dstSet = cullDescriptorSet;
+			descriptorWrites[i].dstBinding = i;
+			descriptorWrites[i].dstArrayElement = 0;
+			descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[i].descriptorCount = 1;
+		}
+
+		for (uint32_t i = 0; i < 4; i++) {
+			descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[4].pImageInfo = &pyramidInfo;
+		descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrites[5].pBufferInfo = &bufferInfos[4];
+
+		vkUpdateDescriptorSets(
+				logicalDevice_,
+				static_cast<uint32_t>(descriptorWrites.size()),
+				descriptorWrites.data(),
+				0,
+				nullptr);
+
+		vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE,
+				cullPipelineLayout_,
+				0, // index of the first descriptor set
+				1, // number of sets to bind
+				&cullDescriptorSet,
+				0,
+				nullptr);
+	}
+
+	// one indirect draw per material, however many commands cull.comp wrote for
+	// it, so the CPU cost doesn't depend on the number of renderables
+	void recordIndirectDraws(
+			VkCommandBuffer commandBuffer,
+			size_t frameIndex,
+			bool depthOnly,
+			BoundState& boundState) {
+		const CullBuffers& buffers = cullBuffers_[frameIndex];
+
+		for (MaterialId materialId = 0;
+				materialId < materialRenderableCounts_.size();
+				materialId++) {
+			if (materialRenderableCounts_[materialId] == 0) {
+				continue;
+			}
+
+			this->bindMaterial(commandBuffer, materialId, depthOnly, boundState);
+
+			cmdDrawIndexedIndirectCount_(
+					commandBuffer,
+					buffers.commandBuffer,
+					materialCommandOffsets_[materialId] *
+							sizeof(VkDrawIndexedIndirectCommand), // offset of the material's commands
+					buffers.countBuffer,
+					materialId * sizeof(uint32_t), // offset of the material's draw count
+					materialRenderableCounts_[materialId], // max draw count
+					sizeof(VkDrawIndexedIndirectCommand)); // stride
+		}
 	}
 
 	// **************************************************************************
 	// * Descriptor Sets
 	// **************************************************************************
 
-	void createDescriptorSetLayout() {
+	void createDescriptorSetLayouts() {
+		// set 0: per-frame uniforms
 		VkDescriptorSetLayoutBinding uboLayoutBinding{};
 		uboLayoutBinding.binding = 0; // binding = 0 in the shader
 		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -1642,112 +3996,174 @@ struct Renderer {
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // which stage this will be referenced
 		uboLayoutBinding.pImmutableSamplers = nullptr; // only relevant for image sampling
 
+		// per-instance data, which can be much larger than a uniform buffer allows
+		VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+		instanceLayoutBinding.binding = 1;
+		instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		instanceLayoutBinding.descriptorCount = 1;
+		instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		instanceLayoutBinding.pImmutableSamplers = nullptr;
+
+		// with push descriptors, the frame set is never allocated, it's pushed
+		// into the command buffer when recording
+		frameDescriptorSetLayout_ = this->createDescriptorSetLayout(
+				{ uboLayoutBinding, instanceLayoutBinding },
+				pushDescriptorSupported_ ?
+						VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0);
+
+		// set 1: the texture table
+		// every texture lives in one array, and draws pick theirs with an index,
+		// so switching textures doesn't mean switching descriptor sets
+		// the array has to fit within the device's per-stage and per-set limits,
+		// and an update after bind table is counted against its own limits
+		if (descriptorIndexingSupported_) {
+			textureTableSize_ = std::min(kMaxTextures, maxUpdateAfterBindTextures_);
+		} else {
+			VkPhysicalDeviceProperties properties{};
+			vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+			textureTableSize_ = std::min({
+				kMaxTextures,
+				properties.limits.maxPerStageDescriptorSamplers,
+				properties.limits.maxPerStageDescriptorSampledImages,
+				properties.limits.maxDescriptorSetSamplers,
+				properties.limits.maxDescriptorSetSampledImages
+			});
+		}
+
+		std::cout << "texture table size: " << textureTableSize_ << "\n\n";
+
 		// combined image samplers make it possible for shaders to access an image
 		// resource through a sampler object
 		VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-		samplerLayoutBinding.binding = 1;
+		samplerLayoutBinding.binding = 0;
 		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		samplerLayoutBinding.descriptorCount = 1;
+		samplerLayoutBinding.descriptorCount = textureTableSize_;
 		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT; // we could use texture sampling in the vertex shader, to modify vertices a la a heightmap
 		samplerLayoutBinding.pImmutableSamplers = nullptr;
 
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = {
-				uboLayoutBinding,
-				samplerLayoutBinding};
+		if (descriptorIndexingSupported_) {
+			// new textures can be written into unused slots while the table is
+			// bound in a pending command buffer, and slots can be left empty
+			textureDescriptorSetLayout_ = this->createDescriptorSetLayout(
+					{ samplerLayoutBinding },
+					VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+					{
+						VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+						VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT |
+						VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+					});
+		} else {
+			textureDescriptorSetLayout_ =
+					this->createDescriptorSetLayout({ samplerLayoutBinding });
+		}
+	}
+
+	// bindingFlags is either empty, or has one entry per binding
+	VkDescriptorSetLayout createDescriptorSetLayout(
+			const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+			VkDescriptorSetLayoutCreateFlags flags = 0,
+			const std::vector<VkDescriptorBindingFlagsEXT>& bindingFlags = {}) {
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+		bindingFlagsInfo.sType =
+				VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+		bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+		bindingFlagsInfo.pBindingFlags = bindingFlags.data();
 
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = bindingFlags.empty() ? nullptr : &bindingFlagsInfo;
+		layoutInfo.flags = flags;
 		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 		layoutInfo.pBindings = bindings.data();
 
+		VkDescriptorSetLayout descriptorSetLayout;
+
 		if (
 				vkCreateDescriptorSetLayout(
 						logicalDevice_,
 						&layoutInfo,
 						nullptr,
-						&descriptorSetLayout_) != VK_SUCCESS) {
+						&descriptorSetLayout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create descriptor set layout");
 		}
-	}
 
-	void createDescriptorPool() {
-		// validation layers will not catch inadequate descriptor pools!
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages_.size());
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages_.size());
+		return descriptorSetLayout;
+	}
 
-		VkDescriptorPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(swapChainImages_.size());
-		poolInfo.flags = 0;
+	// the frame set is allocated fresh every frame, which costs next to nothing
+	// with a linear allocator, and means it never has to be recreated along
+	// with the swap chain
+	void createFrameDescriptorAllocators() {
+		// a frame set is one uniform buffer and one instance buffer, and a cull
+		// set is four storage buffers, the depth pyramid and a uniform buffer, so
+		// size for the larger of each
+		std::vector<VkDescriptorPoolSize> poolSizes = {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
+		};
 
-		if (
-				vkCreateDescriptorPool(
-						logicalDevice_,
-						&poolInfo,
-						nullptr,
-						&descriptorPool_) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create descriptor pool");
+		for (DescriptorAllocator& allocator : frameDescriptorAllocators_) {
+			allocator.init(logicalDevice_, poolSizes);
 		}
 	}
 
-	void createDescriptorSets() {
-		std::vector<VkDescriptorSetLayout> layouts(
-				swapChainImages_.size(), descriptorSetLayout_);
-
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = descriptorPool_;
-		allocInfo.descriptorSetCount =
-				static_cast<uint32_t>(swapChainImages_.size());
-		allocInfo.pSetLayouts = layouts.data();
-
-		descriptorSets_.resize(swapChainImages_.size());
+	FrameDescriptorData getFrameDescriptorData(size_t frameIndex) {
+		FrameDescriptorData descriptorData{};
+		descriptorData.uniforms.buffer = uniformBuffers_[frameIndex];
+		descriptorData.uniforms.offset = 0;
+		descriptorData.uniforms.range = sizeof(FrameUniforms);
+		descriptorData.instances.buffer = instanceBuffers_[frameIndex];
+		descriptorData.instances.offset = 0;
+		descriptorData.instances.range = VK_WHOLE_SIZE; // the scene may be empty
 
-		if (
-				vkAllocateDescriptorSets(
-						logicalDevice_,
-						&allocInfo,
-						descriptorSets_.data()) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate descriptor sets");
-		}
+		return descriptorData;
+	}
 
-		for (size_t i = 0; i < swapChainImages_.size(); i++) {
-			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = uniformBuffers_[i];
-			bufferInfo.offset = 0;
-			bufferInfo.range = sizeof(UniformBufferObject);
+	// binds the frame's uniforms to set 0
+	void bindFrameDescriptors(VkCommandBuffer commandBuffer, size_t frameIndex) {
+		FrameDescriptorData descriptorData = this->getFrameDescriptorData(frameIndex);
+
+		if (pushDescriptorSupported_) {
+			// no allocation or vkUpdateDescriptorSets, the data goes straight into
+			// the command buffer
+			cmdPushDescriptorSetWithTemplate_(
+					commandBuffer,
+					frameDescriptorUpdateTemplate_,
+					pipelineLayout_,
+					0, // set number
+					&descriptorData);
+			return;
+		}
 
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.imageView = textureImageView_;
-			imageInfo.sampler = textureSampler_;
+		// freed when this frame slot comes around again
+		VkDescriptorSet frameDescriptorSet =
+				frameDescriptorAllocators_[frameIndex].allocate(frameDescriptorSetLayout_);
 
+		if (descriptorUpdateTemplateSupported_) {
+			updateDescriptorSetWithTemplate_(
+					logicalDevice_,
+					frameDescriptorSet,
+					frameDescriptorUpdateTemplate_,
+					&descriptorData);
+		} else {
 			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-			// ubo
 			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = descriptorSets_[i];
+			descriptorWrites[0].dstSet = frameDescriptorSet;
 			descriptorWrites[0].dstBinding = 0;
 			descriptorWrites[0].dstArrayElement = 0; // descriptor could be an array (but in this case, it's not)
 			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 			descriptorWrites[0].descriptorCount = 1; // how many array elements to update
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-			descriptorWrites[0].pImageInfo = nullptr;
-			descriptorWrites[0].pTexelBufferView = nullptr;
-			// combined image sampler
+			descriptorWrites[0].pBufferInfo = &descriptorData.uniforms;
+
 			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = descriptorSets_[i];
+			descriptorWrites[1].dstSet = frameDescriptorSet;
 			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0; // descriptor could be an array (but in this case, it's not)
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1; // how many array elements to update
-			descriptorWrites[1].pBufferInfo = nullptr;
-			descriptorWrites[1].pImageInfo = &imageInfo;
-			descriptorWrites[1].pTexelBufferView = nullptr;
+			descriptorWrites[1].dstArrayElement = 0;
+			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[1].descriptorCount = 1;
+			descriptorWrites[1].pBufferInfo = &descriptorData.instances;
 
 			vkUpdateDescriptorSets(
 					logicalDevice_,
@@ -1756,6 +4172,78 @@ struct Renderer {
 					0,
 					nullptr);
 		}
+
+		vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				pipelineLayout_,
+				0, // index of the first descriptor set
+				1, // number of sets to bind
+				&frameDescriptorSet, // array of sets to bind
+				0, // number of items in the below array
+				nullptr); // array of offsets that are used for dynamic descriptors (not used yet)
+	}
+
+	// update templates are created against a set layout, or for push
+	// descriptors, against the pipeline layout and set number
+	// the texture table is written a slot at a time, so it doesn't use one
+	void createDescriptorUpdateTemplates() {
+		if (!descriptorUpdateTemplateSupported_) {
+			return;
+		}
+
+		std::vector<VkDescriptorUpdateTemplateEntryKHR> frameEntries(2);
+		frameEntries[0].dstBinding = 0;
+		frameEntries[0].dstArrayElement = 0;
+		frameEntries[0].descriptorCount = 1;
+		frameEntries[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		frameEntries[0].offset = offsetof(FrameDescriptorData, uniforms);
+		frameEntries[0].stride = sizeof(FrameDescriptorData);
+
+		frameEntries[1].dstBinding = 1;
+		frameEntries[1].dstArrayElement = 0;
+		frameEntries[1].descriptorCount = 1;
+		frameEntries[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		frameEntries[1].offset = offsetof(FrameDescriptorData, instances);
+		frameEntries[1].stride = sizeof(FrameDescriptorData);
+
+		frameDescriptorUpdateTemplate_ = this->createDescriptorUpdateTemplate(
+				frameEntries,
+				pushDescriptorSupported_ ?
+						VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR :
+						VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR,
+				frameDescriptorSetLayout_,
+				0);
+	}
+
+	VkDescriptorUpdateTemplateKHR createDescriptorUpdateTemplate(
+			const std::vector<VkDescriptorUpdateTemplateEntryKHR>& entries,
+			VkDescriptorUpdateTemplateTypeKHR templateType,
+			VkDescriptorSetLayout setLayout,
+			uint32_t setNumber) {
+		VkDescriptorUpdateTemplateCreateInfoKHR createInfo{};
+		createInfo.sType =
+				VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+		createInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+		createInfo.pDescriptorUpdateEntries = entries.data();
+		createInfo.templateType = templateType;
+		createInfo.descriptorSetLayout = setLayout; // ignored for push descriptors
+		createInfo.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS; // only used for push descriptors
+		createInfo.pipelineLayout = pipelineLayout_; // ditto
+		createInfo.set = setNumber; // ditto
+
+		VkDescriptorUpdateTemplateKHR updateTemplate;
+
+		if (
+				createDescriptorUpdateTemplate_(
+						logicalDevice_,
+						&createInfo,
+						nullptr,
+						&updateTemplate) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor update template");
+		}
+
+		return updateTemplate;
 	}
 
 	// **************************************************************************
@@ -1763,7 +4251,8 @@ struct Renderer {
 	// **************************************************************************
 
 	void createCommandBuffers() {
-		commandBuffers_.resize(swapChainFramebuffers_.size());
+		// one command buffer per frame in flight, re-recorded every frame
+		commandBuffers_.resize(MAX_FRAMES_IN_FLIGHT);
 
 		VkCommandBufferAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1776,84 +4265,255 @@ struct Renderer {
 						logicalDevice_, &allocInfo, commandBuffers_.data()) != VK_SUCCESS) {
 			throw std::runtime_error("failed to allocate command buffers");
 		}
+	}
+
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // re-recorded before every submission
+		beginInfo.pInheritanceInfo = nullptr; // optional, only relevant for secondary command buffers
 
-		for (size_t i = 0; i < commandBuffers_.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // optional
-			beginInfo.pInheritanceInfo = nullptr; // optional, only relevant for secondary command buffers
+		// beginning a command buffer implicitly resets it, because the pool was
+		// created with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer");
+		}
+
+		bindStats_ = BindStats{};
 
-			if (vkBeginCommandBuffer(commandBuffers_[i], &beginInfo) != VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer");
+		if (!gpuCullingEnabled_) {
+			this->recordScenePass(commandBuffer, imageIndex, renderPass_);
+		} else {
+			if (depthPyramidNeedsTransition_) {
+				this->recordDepthPyramidTransition(commandBuffer);
 			}
 
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass_;
-			renderPassInfo.framebuffer = swapChainFramebuffers_[i];
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = swapChainExtent_;
-
-			// because there are multiple attachments with VK_ATTACHMENT_LOAD_OP_CLEAR,
-			// we need to specify multiple clear values
-			std::array<VkClearValue, 2> clearValues{};
-			// the order of clear values should be identical to the order of attachments
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = {
-				1.0f, // clear value for the depth aspect, the initial value at each point in the depth buffer should be the furthest possible depth, 1.0
-				0 // clear value for the stencil aspect
-			};
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+			// compute can't run inside a render pass, so each phase of culling
+			// goes before the pass that draws what it found
+			// the early phase draws what was visible last frame, which the depth
+			// pyramid is then built from, to find what else is visible
+			this->recordCulling(commandBuffer, currentFrame_, kCullPhaseEarly);
+			this->recordScenePass(commandBuffer, imageIndex, renderPass_);
+			this->recordDepthPyramid(commandBuffer);
+			this->recordCulling(commandBuffer, currentFrame_, kCullPhaseLate);
+			this->recordScenePass(commandBuffer, imageIndex, lateRenderPass_);
+		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer");
+		}
+	}
+
+	// everything between beginning and ending the render pass, which is the
+	// same for both of GPU culling's passes, besides what ends up drawn
+	void recordScenePass(
+			VkCommandBuffer commandBuffer,
+			uint32_t imageIndex,
+			VkRenderPass renderPass) {
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers_[imageIndex];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent_;
+
+		// because there are multiple attachments with VK_ATTACHMENT_LOAD_OP_CLEAR,
+		// we need to specify multiple clear values (ignored by the late pass,
+		// which loads them)
+		std::array<VkClearValue, 2> clearValues{};
+		// the order of clear values should be identical to the order of attachments
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearValues[1].depthStencil = {
+			1.0f, // clear value for the depth aspect, the initial value at each point in the depth buffer should be the furthest possible depth, 1.0
+			0 // clear value for the stencil aspect
+		};
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		// functions that record commands begin with vkCmd
+		vkCmdBeginRenderPass(
+				commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		// sets 0 and 1 stay bound across pipeline changes, since every pipeline
+		// shares the same layout
+		this->bindFrameDescriptors(commandBuffer, currentFrame_);
+		bindStats_.descriptorSets++;
+
+		// the texture table is bound once, and draws index into it
+		vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				pipelineLayout_,
+				1, // index of the first descriptor set
+				1, // number of sets to bind
+				&textureDescriptorSet_,
+				0,
+				nullptr);
+		bindStats_.descriptorSets++;
+
+		// every mesh is in the geometry pool, so this is the only index buffer
+		// bind, and the vertex buffer is only switched for the depth prepass
+		vkCmdBindIndexBuffer(
+				commandBuffer,
+				geometryPool_.indexBuffer_, // there can only be one
+				0, // byte offset into buffer
+				VK_INDEX_TYPE_UINT32); // size of each index in Model::indices
+		bindStats_.vertexAndIndexBuffers++;
+
+		// nothing is bound at the start of a render pass
+		BoundState boundState;
+
+		// the same draws twice, first for depth only, so the second time around
+		// the fragment shader only runs for the nearest surface
+		if (depthPrepassEnabled_) {
+			this->bindVertexBuffer(commandBuffer, geometryPool_.positionBuffer_);
+			this->recordSceneDraws(commandBuffer, true, boundState);
+		}
+
+		this->bindVertexBuffer(commandBuffer, geometryPool_.vertexBuffer_);
+		this->recordSceneDraws(commandBuffer, false, boundState);
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
 
-			// functions that record commands begin with vkCmd
-			vkCmdBeginRenderPass(
-					commandBuffers_[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	void bindVertexBuffer(VkCommandBuffer commandBuffer, VkBuffer vertexBuffer) {
+		VkBuffer vertexBuffers[] = { vertexBuffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(
+				commandBuffer,
+				0, // offset
+				1, // number of bindings
+				vertexBuffers,
+				offsets); // byte offsets to start vertex reading data from
+		bindStats_.vertexAndIndexBuffers++;
+	}
+
+	// everything culling left visible, with either the material pipelines or
+	// the depth prepass pipeline
+	void recordSceneDraws(
+			VkCommandBuffer commandBuffer, bool depthOnly, BoundState& boundState) {
+		if (gpuCullingEnabled_) {
+			this->recordIndirectDraws(
+					commandBuffer, currentFrame_, depthOnly, boundState);
+		} else {
+			this->recordDrawBatches(
+					commandBuffer, currentFrame_, depthOnly, boundState);
+		}
+	}
 
+	// binds the material's pipeline (or the depth prepass pipeline, which every
+	// material shares) and dynamic state, skipping whatever is already bound
+	// the material's texture index comes from the instance data
+	void bindMaterial(
+			VkCommandBuffer commandBuffer,
+			MaterialId materialId,
+			bool depthOnly,
+			BoundState& boundState) {
+		PipelineDescription pipelineDescription = depthOnly ?
+				this->getDepthPrepassPipelineDescription() :
+				this->getMaterialPipelineDescription(materialId, depthPrepassEnabled_);
+		const GraphicsPipeline& pipeline =
+				this->getGraphicsPipeline(pipelineDescription);
+
+		if (pipeline.pipeline != boundState.pipeline) {
 			vkCmdBindPipeline(
-					commandBuffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
+					commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+			bindStats_.pipelines++;
 
-			// bind the vertex buffer to the command buffer
-			VkBuffer vertexBuffers[] = { vertexBuffer_ };
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(
-					commandBuffers_[i],
-					0, // offset
-					1, // number of bindings
-					vertexBuffers,
-					offsets); // byte offsets to start vertex reading data from
+			this->setDynamicState(
+					commandBuffer, pipelineDescription.rasterState, boundState);
+			boundState.pipeline = pipeline.pipeline;
+		}
+	}
 
-			vkCmdBindIndexBuffer(
-					commandBuffers_[i],
-					indexBuffer_, // there can only be one
-					0, // byte offset into buffer
-					VK_INDEX_TYPE_UINT32); // size of each index in model_->indices
+	// draws what the CPU culled and grouped in buildDrawBatches()
+	void recordDrawBatches(
+			VkCommandBuffer commandBuffer,
+			size_t frameIndex,
+			bool depthOnly,
+			BoundState& boundState) {
+		// batches are sorted by pipeline, so pipelines rarely change
+
+		// one call per pipeline, however many meshes and materials use it
+		if (batchedIndirectDrawsEnabled_) {
+			for (const IndirectDrawGroup& group : indirectDrawGroups_) {
+				this->bindMaterial(
+						commandBuffer, group.materialId, depthOnly, boundState);
+
+				vkCmdDrawIndexedIndirect(
+						commandBuffer,
+						indirectBuffers_[frameIndex],
+						group.firstCommand * sizeof(VkDrawIndexedIndirectCommand), // offset
+						group.commandCount, // draw count
+						sizeof(VkDrawIndexedIndirectCommand)); // stride
+			}
 
-			vkCmdBindDescriptorSets(
-					commandBuffers_[i],
-					VK_PIPELINE_BIND_POINT_GRAPHICS,
-					pipelineLayout_,
-					0, // index of the first descriptor set
-					1, // number of sets to bind
-					&descriptorSets_[i], // array of sets to bind
-					0, // number of items in the below array
-					nullptr); // array of offsets that are used for dynamic descriptors (not used yet)
+			return;
+		}
 
-			// using an index buffer:
+		for (const DrawBatch& batch : drawBatches_) {
+			this->bindMaterial(
+					commandBuffer, batch.materialId, depthOnly, boundState);
+
+			const MeshRange& mesh = meshRanges_[batch.meshId];
+
+			// every instance in the batch in one draw, the vertex shader looks up
+			// each one's transform with gl_InstanceIndex
 			vkCmdDrawIndexed(
-					commandBuffers_[i],
-					static_cast<uint32_t>(model_->indices.size()), // number of indices
-					1, // number of instances (not using instances, so just 1 for now)
-					0, // offset into the index buffer
-					0, // offset to add to the indices in the index buffer
-					0); // offset for instancing (not using)
+					commandBuffer,
+					mesh.indexCount, // number of indices
+					batch.instanceCount, // number of instances
+					mesh.firstIndex, // offset into the index buffer
+					static_cast<int32_t>(mesh.firstVertex), // offset to add to the indices in the index buffer
+					batch.firstInstance); // first instance, added to gl_InstanceIndex
+		}
+	}
 
-			vkCmdEndRenderPass(commandBuffers_[i]);
+	// state that isn't baked into the pipeline has to be set after binding it
+	// dynamic state outlives pipeline binds, so each piece is only set when
+	// it changes
+	void setDynamicState(
+			VkCommandBuffer commandBuffer,
+			const RasterState& rasterState,
+			BoundState& boundState) {
+		if (!boundState.viewportSet) {
+			this->setViewportAndScissor(commandBuffer);
+			boundState.viewportSet = true;
+		}
 
-			if (vkEndCommandBuffer(commandBuffers_[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer");
-			}
+		if (!extendedDynamicStateSupported_ || boundState.rasterState == rasterState) {
+			return;
 		}
+
+		cmdSetCullMode_(commandBuffer, rasterState.cullMode);
+		cmdSetFrontFace_(commandBuffer, rasterState.frontFace);
+		cmdSetDepthTestEnable_(commandBuffer, rasterState.depthTestEnable);
+		cmdSetDepthWriteEnable_(commandBuffer, rasterState.depthWriteEnable);
+		cmdSetDepthCompareOp_(commandBuffer, rasterState.depthCompareOp);
+		bindStats_.dynamicStates += 5;
+
+		boundState.rasterState = rasterState;
+	}
+
+	// the whole swap chain image, which doesn't change within a pass
+	void setViewportAndScissor(VkCommandBuffer commandBuffer) {
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = (float)swapChainExtent_.width;
+		viewport.height = (float)swapChainExtent_.height;
+		viewport.minDepth = 0.0f; // standard values
+		viewport.maxDepth = 1.0f;
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		// scissors are used for filtering areas out of the framebuffer
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = swapChainExtent_;
+
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		bindStats_.dynamicStates += 2;
 	}
 
 	// all uses of this execute synchronously by waiting for the queue to become
@@ -1948,12 +4608,124 @@ struct Renderer {
 		}
 	}
 
+	// **************************************************************************
+	// * Texture Table
+	// **************************************************************************
+
+	// the table's set is allocated once and never reallocated, textures are
+	// written into it as they're added
+	void createTextureTable() {
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSize.descriptorCount = textureTableSize_;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = 1;
+
+		// update after bind layouts can only be allocated from matching pools
+		poolInfo.flags = descriptorIndexingSupported_ ?
+				VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+
+		if (
+				vkCreateDescriptorPool(
+						logicalDevice_,
+						&poolInfo,
+						nullptr,
+						&textureDescriptorPool_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture descriptor pool");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = textureDescriptorPool_;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &textureDescriptorSetLayout_;
+
+		if (
+				vkAllocateDescriptorSets(
+						logicalDevice_,
+						&allocInfo,
+						&textureDescriptorSet_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate texture descriptor set");
+		}
+
+		// materials can share textures, so each one is only uploaded once
+		std::unordered_map<Texture*, uint32_t> textureIndices;
+
+		for (const Material& material : scene_->materials_) {
+			auto found = textureIndices.find(material.texture);
+
+			if (found == textureIndices.end()) {
+				found = textureIndices.emplace(
+						material.texture, this->addTexture(material.texture)).first;
+			}
+
+			materialTextureIndices_.push_back(found->second);
+		}
+	}
+
+	// uploads the texture and returns its slot in the texture table, which
+	// materials use to refer to it
+	uint32_t addTexture(Texture* texture) {
+		if (textures_.size() >= textureTableSize_) {
+			throw std::runtime_error("texture table is full");
+		}
+
+		TextureImage textureImage;
+		this->createTextureImage(texture, textureImage.image, textureImage.memory);
+		textureImage.view = this->createImageView(
+				textureImage.image,
+				VK_FORMAT_R8G8B8A8_SRGB,
+				VK_IMAGE_ASPECT_COLOR_BIT);
+
+		uint32_t textureIndex = static_cast<uint32_t>(textures_.size());
+		textures_.push_back(textureImage);
+
+		this->writeTextureDescriptor(textureIndex);
+
+		return textureIndex;
+	}
+
+	void writeTextureDescriptor(uint32_t textureIndex) {
+		// without partially bound descriptors every slot has to be valid, so the
+		// first texture fills the whole table, and later ones replace their slot
+		// those later writes are only safe while no frame using the table is in
+		// flight, which holds because the upload in createTextureImage() waits
+		// for the queue to go idle
+		uint32_t descriptorCount =
+				(!descriptorIndexingSupported_ && textureIndex == 0) ?
+						textureTableSize_ : 1;
+
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = textures_[textureIndex].view;
+		imageInfo.sampler = textureSampler_;
+
+		std::vector<VkDescriptorImageInfo> imageInfos(descriptorCount, imageInfo);
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = textureDescriptorSet_;
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = textureIndex; // the slot in the table
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = descriptorCount;
+		descriptorWrite.pBufferInfo = nullptr;
+		descriptorWrite.pImageInfo = imageInfos.data();
+		descriptorWrite.pTexelBufferView = nullptr;
+
+		vkUpdateDescriptorSets(logicalDevice_, 1, &descriptorWrite, 0, nullptr);
+	}
+
 	// **************************************************************************
 	// * Texture Image
 	// **************************************************************************
 
-	void createTextureImage() {
-		Texture* texture = model_->texture;
+	void createTextureImage(
+			Texture* texture, VkImage& textureImage, VkDeviceMemory& textureImageMemory) {
 
 		// set up the staging buffer
 		// VkDeviceSize imageSize = textureWidth * textureHeight * 4;
@@ -2001,8 +4773,8 @@ struct Renderer {
 				initialLayout,
 				usageFlags,
 				desiredMemoryProperties,
-				textureImage_,
-				textureImageMemory_);
+				textureImage,
+				textureImageMemory);
 
 		// perform copy from buffer to image
 		// we could just use VK_IMAGE_LAYOUT_GENERAL and skip all this
@@ -2010,18 +4782,18 @@ struct Renderer {
 		VkImageLayout intermediateLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 
 		this->transitionImageLayout(
-				textureImage_,
+				textureImage,
 				imageFormat,
 				initialLayout,
 				intermediateLayout);
 
 		this->copyBufferToImage(
-				stagingBuffer, textureImage_, texture->width, texture->height);
+				stagingBuffer, textureImage, texture->width, texture->height);
 
 		// after the copy, we need one more transition to start sampling the
 		// texture image in the shader
 		this->transitionImageLayout(
-				textureImage_,
+				textureImage,
 				imageFormat,
 				intermediateLayout,
 				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -2039,14 +4811,15 @@ struct Renderer {
 			VkImageUsageFlags usageFlags,
 			VkMemoryPropertyFlags desiredMemoryProperties,
 			VkImage& image,
-			VkDeviceMemory& imageMemory) {
+			VkDeviceMemory& imageMemory,
+			uint32_t mipLevels = 1) {
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType = VK_IMAGE_TYPE_2D; // 3D images can be used to store voxel volumes
 		imageInfo.extent.width = width; // how many "texels" are on each axis (also, next two)
 		imageInfo.extent.height = height;
 		imageInfo.extent.depth = 1;
-		imageInfo.mipLevels = 1; // not using mipmapping for now
+		imageInfo.mipLevels = mipLevels; // only the depth pyramid uses more than one
 		imageInfo.arrayLayers = 1; // not an array
 		imageInfo.format = format;
 		imageInfo.tiling = tiling;
@@ -2217,11 +4990,6 @@ struct Renderer {
 		this->endSingleUseTempCommandBuffer(tempCommandBuffer);
 	}
 
-	void createTextureImageView() {
-		textureImageView_ = this->createImageView(
-				textureImage_, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-	}
-
 	// samplers allow us to apply things like bilinear (mag) and anisotropic
 	// (min) filters, to prevent graphical nasties, and to specify the
 	// addressing mode (when texels are read beyond the image's bounds)
@@ -2276,7 +5044,9 @@ struct Renderer {
 				depthFormat,
 				VK_IMAGE_TILING_OPTIMAL,
 				initialLayout,
-				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+				gpuCullingEnabled_ ?
+						VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT :
+						VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				depthImage_,
 				depthImageMemory_);
@@ -2284,11 +5054,9 @@ struct Renderer {
 		depthImageView_ = this->createImageView(
 				depthImage_, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-		// this isn't necessary??
-		VkImageLayout newLayout =
-				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		this->transitionImageLayout(
-				depthImage_, depthFormat, initialLayout, newLayout);
+		// no explicit layout transition needed: the render pass transitions the
+		// depth attachment from VK_IMAGE_LAYOUT_UNDEFINED itself, and skipping it
+		// avoids a queue wait every time the swap chain is recreated
 	}
 
 	VkFormat findSupportedFormat(
@@ -2326,10 +5094,17 @@ struct Renderer {
 			VK_FORMAT_D24_UNORM_S8_UINT
 		};
 
+		// with GPU culling, the depth pyramid is built by sampling it
+		VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+		if (gpuCullingEnabled_) {
+			features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+		}
+
 		return this->findSupportedFormat(
 				candidateFormats,
 				VK_IMAGE_TILING_OPTIMAL,
-				VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+				features);
 	}
 
 	bool hasStencilComponent(VkFormat format) {
@@ -2337,10 +5112,349 @@ struct Renderer {
 				format == VK_FORMAT_D24_UNORM_S8_UINT;
 	}
 
+	// **************************************************************************
+	// * Depth Pyramid
+	// **************************************************************************
+
+	// the depth buffer, downsampled over and over with depth_reduce.comp, for
+	// cull.comp to test bounds against without reading every pixel they cover
+	// level 0 is half the size of the depth buffer, rounded up, and each level
+	// after that is an ordinary mip, half the size of the one before rounded
+	// down, to 1x1; depth_reduce.comp folds the row or column that rounding
+	// down leaves out into the last texel, so no pixel's depth is lost
+	void createDepthPyramid() {
+		if (!gpuCullingEnabled_) {
+			return;
+		}
+
+		depthPyramidWidth_ = (swapChainExtent_.width + 1) / 2;
+		depthPyramidHeight_ = (swapChainExtent_.height + 1) / 2;
+		depthPyramidLevelCount_ = 1;
+
+		while ((std::max(depthPyramidWidth_, depthPyramidHeight_) >> depthPyramidLevelCount_) > 0) {
+			depthPyramidLevelCount_++;
+		}
+
+		this->createImageAndAllocateMemory(
+				depthPyramidWidth_,
+				depthPyramidHeight_,
+				VK_FORMAT_R32_SFLOAT,
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				depthPyramidImage_,
+				depthPyramidMemory_,
+				depthPyramidLevelCount_);
+
+		// cull.comp reads every level through one view, depth_reduce.comp writes
+		// one level at a time
+		depthPyramidView_ = this->createImageView(
+				depthPyramidImage_,
+				VK_FORMAT_R32_SFLOAT,
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				0,
+				depthPyramidLevelCount_);
+
+		depthPyramidLevelViews_.resize(depthPyramidLevelCount_);
+
+		for (uint32_t level = 0; level < depthPyramidLevelCount_; level++) {
+			depthPyramidLevelViews_[level] = this->createImageView(
+					depthPyramidImage_,
+					VK_FORMAT_R32_SFLOAT,
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					level);
+		}
+
+		this->createDepthReduceDescriptorSets();
+
+		// the first frame's early cull reads the pyramid before anything has been
+		// written to it, so it needs to be in the layout cull.comp expects
+		depthPyramidNeedsTransition_ = true;
+	}
+
+	// one set per level, which never change until the swap chain is recreated,
+	// so they get their own pool rather than coming from the frame allocators
+	void createDepthReduceDescriptorSets() {
+		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[0].descriptorCount = depthPyramidLevelCount_;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[1].descriptorCount = depthPyramidLevelCount_;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = depthPyramidLevelCount_;
+
+		if (
+				vkCreateDescriptorPool(
+						logicalDevice_,
+						&poolInfo,
+						nullptr,
+						&depthReduceDescriptorPool_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth reduce descriptor pool");
+		}
+
+		std::vector<VkDescriptorSetLayout> setLayouts(
+				depthPyramidLevelCount_, depthReduceDescriptorSetLayout_);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = depthReduceDescriptorPool_;
+		allocInfo.descriptorSetCount = depthPyramidLevelCount_;
+		allocInfo.pSetLayouts = setLayouts.data();
+
+		depthReduceDescriptorSets_.resize(depthPyramidLevelCount_);
+
+		if (
+				vkAllocateDescriptorSets(
+						logicalDevice_,
+						&allocInfo,
+						depthReduceDescriptorSets_.data()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate depth reduce descriptor sets");
+		}
+
+		for (uint32_t level = 0; level < depthPyramidLevelCount_; level++) {
+			// level 0 is built from the depth buffer, the rest from the level above
+			VkDescriptorImageInfo sourceInfo{};
+			sourceInfo.sampler = depthPyramidSampler_;
+
+			if (level == 0) {
+				sourceInfo.imageView = depthImageView_;
+				sourceInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			} else {
+				sourceInfo.imageView = depthPyramidLevelViews_[level - 1];
+				sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			}
+
+			VkDescriptorImageInfo destinationInfo{};
+			destinationInfo.imageView = depthPyramidLevelViews_[level];
+			destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+
+			for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+				descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptorWrites[i].dstSet = depthReduceDescriptorSets_[level];
+				descriptorWrites[i].dstBinding = i;
+				descriptorWrites[i].dstArrayElement = 0;
+				descriptorWrites[i].descriptorCount = 1;
+			}
+
+			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[0].pImageInfo = &sourceInfo;
+			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			descriptorWrites[1].pImageInfo = &destinationInfo;
+
+			vkUpdateDescriptorSets(
+					logicalDevice_,
+					static_cast<uint32_t>(descriptorWrites.size()),
+					descriptorWrites.data(),
+					0,
+					nullptr);
+		}
+	}
+
+	// depth_reduce.comp and cull.comp only use texelFetch, which ignores
+	// filtering, but combined image samplers still need a sampler
+	void createDepthPyramidSampler() {
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.anisotropyEnable = VK_FALSE;
+		samplerInfo.maxAnisotropy = 1.0f;
+		samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		samplerInfo.unnormalizedCoordinates = VK_FALSE;
+		samplerInfo.compareEnable = VK_FALSE;
+		samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.mipLodBias = 0.0f;
+		samplerInfo.minLod = 0.0f;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (
+				vkCreateSampler(
+						logicalDevice_,
+						&samplerInfo,
+						nullptr,
+						&depthPyramidSampler_) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid sampler");
+		}
+	}
+
+	// the pyramid is the size of the swap chain, so it goes along with it
+	void deferDestroyDepthPyramid() {
+		if (!gpuCullingEnabled_) {
+			return;
+		}
+
+		VkDevice device = logicalDevice_;
+		VkDescriptorPool descriptorPool = depthReduceDescriptorPool_;
+		std::vector<VkImageView> levelViews = depthPyramidLevelViews_;
+
+		// the sets are freed along with their pool
+		this->deferDestruction([device, descriptorPool, levelViews]() {
+			vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+
+			for (VkImageView levelView : levelViews) {
+				vkDestroyImageView(device, levelView, nullptr);
+			}
+		});
+
+		this->deferDestroyImage(
+				depthPyramidImage_, depthPyramidView_, depthPyramidMemory_);
+	}
+
+	// between the early and late passes: this frame's depth so far, reduced
+	// level by level into the pyramid
+	void recordDepthPyramid(VkCommandBuffer commandBuffer) {
+		VkFormat depthFormat = this->findDepthFormat();
+		VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+		if (this->hasStencilComponent(depthFormat)) {
+			depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+
+		// the early pass's depth writes have to land before it's sampled
+		VkImageMemoryBarrier depthBarrier{};
+		depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.image = depthImage_;
+		depthBarrier.subresourceRange = { depthAspect, 0, 1, 0, 1 };
+
+		// every level is rewritten, so what was in it doesn't matter, but the
+		// previous frame's late cull has to be done reading it
+		VkImageMemoryBarrier pyramidBarrier{};
+		pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		pyramidBarrier.srcAccessMask = 0;
+		pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		pyramidBarrier.image = depthPyramidImage_;
+		pyramidBarrier.subresourceRange = {
+			VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevelCount_, 0, 1
+		};
+
+		std::array<VkImageMemoryBarrier, 2> barriers = { depthBarrier, pyramidBarrier };
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+						VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				static_cast<uint32_t>(barriers.size()), barriers.data());
+
+		vkCmdBindPipeline(
+				commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipeline_);
+
+		for (uint32_t level = 0; level < depthPyramidLevelCount_; level++) {
+			uint32_t levelWidth = std::max(depthPyramidWidth_ >> level, 1u);
+			uint32_t levelHeight = std::max(depthPyramidHeight_ >> level, 1u);
+
+			vkCmdBindDescriptorSets(
+					commandBuffer,
+					VK_PIPELINE_BIND_POINT_COMPUTE,
+					depthReducePipelineLayout_,
+					0, // index of the first descriptor set
+					1, // number of sets to bind
+					&depthReduceDescriptorSets_[level],
+					0,
+					nullptr);
+
+			vkCmdDispatch(
+					commandBuffer,
+					(levelWidth + kDepthReduceWorkgroupSize - 1) / kDepthReduceWorkgroupSize,
+					(levelHeight + kDepthReduceWorkgroupSize - 1) / kDepthReduceWorkgroupSize,
+					1);
+
+			// the next level reads this one, and the late cull reads all of them
+			VkImageMemoryBarrier levelBarrier{};
+			levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			levelBarrier.image = depthPyramidImage_;
+			levelBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+
+			vkCmdPipelineBarrier(
+					commandBuffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0,
+					0, nullptr,
+					0, nullptr,
+					1, &levelBarrier);
+		}
+
+		// and the late pass draws on top of the early pass's depth
+		depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+						VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				1, &depthBarrier);
+	}
+
+	// only needed once after the pyramid is created, after that every frame
+	// leaves it in VK_IMAGE_LAYOUT_GENERAL
+	void recordDepthPyramidTransition(VkCommandBuffer commandBuffer) {
+		VkImageMemoryBarrier pyramidBarrier{};
+		pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		pyramidBarrier.srcAccessMask = 0;
+		pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		pyramidBarrier.image = depthPyramidImage_;
+		pyramidBarrier.subresourceRange = {
+			VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevelCount_, 0, 1
+		};
+
+		vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				1, &pyramidBarrier);
+
+		depthPyramidNeedsTransition_ = false;
+	}
+
 	WindowHandler* windowHandler_;
 	Camera* camera_;
-	// original vertex and index data, provided by the instance owner
-	Model* model_;
+	// everything to draw, owned by the caller and read every frame
+	Scene* scene_;
 
 
 	VkInstance instance_;
@@ -2350,10 +5464,20 @@ struct Renderer {
 	VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
 	VkDevice logicalDevice_;
 
+	bool physicalDeviceProperties2Enabled_ = false;
+
+	// VK_EXT_extended_dynamic_state
+	bool extendedDynamicStateSupported_ = false;
+	PFN_vkCmdSetCullModeEXT cmdSetCullMode_ = nullptr;
+	PFN_vkCmdSetFrontFaceEXT cmdSetFrontFace_ = nullptr;
+	PFN_vkCmdSetDepthTestEnableEXT cmdSetDepthTestEnable_ = nullptr;
+	PFN_vkCmdSetDepthWriteEnableEXT cmdSetDepthWriteEnable_ = nullptr;
+	PFN_vkCmdSetDepthCompareOpEXT cmdSetDepthCompareOp_ = nullptr;
+
 	VkQueue graphicsQueue_;
 	VkQueue presentQueue_;
 
-	VkSwapchainKHR swapChain_;
+	VkSwapchainKHR swapChain_ = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages_;
 	VkFormat swapChainImageFormat_;
 	VkExtent2D swapChainExtent_;
@@ -2362,13 +5486,81 @@ struct Renderer {
 	std::vector<VkImageView> swapChainImageViews_;
 	std::vector<VkFramebuffer> swapChainFramebuffers_;
 
-	VkDescriptorSetLayout descriptorSetLayout_;
-	VkDescriptorPool descriptorPool_;
-	std::vector<VkDescriptorSet> descriptorSets_;
+	VkDescriptorSetLayout frameDescriptorSetLayout_;
+	VkDescriptorSetLayout textureDescriptorSetLayout_;
+	// transient sets, reset when the frame's fence signals (unused with push
+	// descriptors)
+	std::array<DescriptorAllocator, MAX_FRAMES_IN_FLIGHT> frameDescriptorAllocators_;
+
+	// bindless texture table
+	bool descriptorIndexingSupported_ = false;
+	uint32_t maxUpdateAfterBindTextures_ = 0; // only with descriptor indexing
+	uint32_t textureTableSize_ = 0;
+	VkDescriptorPool textureDescriptorPool_ = VK_NULL_HANDLE;
+	VkDescriptorSet textureDescriptorSet_ = VK_NULL_HANDLE;
+	std::vector<TextureImage> textures_; // indexed by texture table slot
+	std::vector<uint32_t> materialTextureIndices_; // indexed by MaterialId
+
+	bool descriptorUpdateTemplateSupported_ = false;
+	bool pushDescriptorSupported_ = false;
+	PFN_vkCreateDescriptorUpdateTemplateKHR createDescriptorUpdateTemplate_ = nullptr;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR destroyDescriptorUpdateTemplate_ = nullptr;
+	PFN_vkUpdateDescriptorSetWithTemplateKHR updateDescriptorSetWithTemplate_ = nullptr;
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate_ = nullptr;
+
+	// multiDrawIndirect and drawIndirectFirstInstance
+	bool multiDrawIndirectEnabled_ = false;
+	uint32_t maxDrawIndirectCount_ = 1;
+	// the CPU culling path draws its batches with vkCmdDrawIndexedIndirect
+	bool batchedIndirectDrawsEnabled_ = false;
+
+	// GPU culling, with VK_KHR_draw_indirect_count
+	bool gpuCullingEnabled_ = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount_ = nullptr;
+	VkDescriptorSetLayout cullDescriptorSetLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout cullPipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline cullPipeline_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout depthReduceDescriptorSetLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout depthReducePipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline depthReducePipeline_ = VK_NULL_HANDLE;
+	VkRenderPass lateRenderPass_ = VK_NULL_HANDLE; // draws what the late cull finds
+	std::array<CullBuffers, MAX_FRAMES_IN_FLIGHT> cullBuffers_;
+	// shared by every frame, since each frame's early cull reads what the last
+	// frame's late cull wrote
+	VkBuffer visibilityBuffer_ = VK_NULL_HANDLE;
+	VkDeviceMemory visibilityBufferMemory_ = VK_NULL_HANDLE;
+	uint32_t visibilityBufferCapacity_ = 0;
+	bool visibilityBufferNeedsClear_ = false;
+	// each material's range of the command buffer, indexed by MaterialId
+	std::vector<uint32_t> materialCommandOffsets_;
+	std::vector<uint32_t> materialRenderableCounts_;
+	VkDescriptorUpdateTemplateKHR frameDescriptorUpdateTemplate_ = VK_NULL_HANDLE;
+
+	VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+	// whether the cache was seeded from disk
+	bool pipelineCacheWarm_ = false;
 
 	VkRenderPass renderPass_;
 	VkPipelineLayout pipelineLayout_;
-	VkPipeline graphicsPipeline_;
+	GraphicsPipelines graphicsPipelines_;
+	RasterState rasterState_; // the default for scene pipeline descriptions
+	bool depthPrepassEnabled_ = kEnableDepthPrepass;
+	uint64_t pipelineCacheHits_ = 0;
+	uint64_t pipelineCacheMisses_ = 0;
+	std::chrono::steady_clock::time_point lastPipelineCacheStatsTime_ =
+			std::chrono::steady_clock::now();
+
+	// shader hot reload
+	std::thread pipelineBuildThread_;
+	std::atomic<bool> pipelineBuildInProgress_{false};
+	bool pipelineReloadQueued_ = false;
+	std::mutex pendingPipelineMutex_;
+	std::optional<PendingPipelines> pendingPipelines_;
+	ShaderWatcher shaderWatcher_{"shaders"};
+#if PHALANX_DYNAMIC_SHADER_COMPILATION == 0
+	ShaderBundle shaderBundle_; // see loadShaderBundle()
+	bool shaderBundleChanged_ = false; // since it was loaded
+#endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 0
 
 	VkCommandPool commandPool_;
 	std::vector<VkCommandBuffer> commandBuffers_;
@@ -2381,25 +5573,74 @@ struct Renderer {
 
 	size_t currentFrame_ = 0;
 
-	// device-side vertex data, resident in vertexBufferMemory_
-	VkBuffer vertexBuffer_;
-	// allocated device memory
-	VkDeviceMemory vertexBufferMemory_;
-
-	VkBuffer indexBuffer_;
-	VkDeviceMemory indexBufferMemory_;
-
-	std::vector<VkBuffer> uniformBuffers_;
-	std::vector<VkDeviceMemory> uniformBuffersMemory_;
-
-	// Image for texture handling
-	VkImage textureImage_;
-	VkDeviceMemory textureImageMemory_;
-	VkImageView textureImageView_;
+	// frame numbers start at 1, so 0 means nothing has been submitted yet
+	uint64_t lastSubmittedFrame_ = 0;
+	uint64_t completedFrame_ = 0;
+	// the frame number most recently submitted with each of inFlightFences_
+	uint64_t inFlightFrameNumbers_[MAX_FRAMES_IN_FLIGHT] = {};
+
+	DeletionQueue deletionQueue_;
+
+	// device-side vertex and index data for every mesh
+	GeometryPool geometryPool_;
+	std::vector<MeshRange> meshRanges_; // indexed by MeshId
+
+	// per frame in flight
+	VkBuffer uniformBuffers_[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory uniformBuffersMemory_[MAX_FRAMES_IN_FLIGHT];
+
+	// per frame in flight, persistently mapped
+	VkBuffer instanceBuffers_[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory instanceBuffersMemory_[MAX_FRAMES_IN_FLIGHT];
+	void* instanceBuffersMapped_[MAX_FRAMES_IN_FLIGHT];
+	uint32_t instanceBufferCapacities_[MAX_FRAMES_IN_FLIGHT];
+
+	// per frame in flight, persistently mapped, with the same capacity as the
+	// instance buffers, only with batchedIndirectDrawsEnabled_
+	VkBuffer indirectBuffers_[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory indirectBuffersMemory_[MAX_FRAMES_IN_FLIGHT];
+	void* indirectBuffersMapped_[MAX_FRAMES_IN_FLIGHT];
+
+	// the scene, culled and grouped into draws, for the frame being recorded
+	Frustum frustum_;
+	std::vector<uint8_t> renderableVisibility_; // indexed by RenderableId
+	std::vector<RenderableId> bvhVisibleRenderables_;
+	std::vector<SortItem> drawKeys_; // renderable ids, sorted by draw key
+	RadixSorter radixSorter_;
+	std::vector<DrawBatch> drawBatches_;
+	std::vector<IndirectDrawGroup> indirectDrawGroups_;
+	std::vector<VkPipeline> materialPipelines_; // indexed by MaterialId
+	std::vector<uint64_t> materialDrawKeys_; // indexed by MaterialId
+	uint32_t drawnRenderableCount_ = 0;
+	uint32_t culledRenderableCount_ = 0;
+	uint32_t occludedRenderableCount_ = 0; // also counted in culledRenderableCount_
+	glm::mat4 viewProjection_;
+	bool softwareOcclusionEnabled_ = false;
+	WorkerPool workerPool_; // outlives the occlusion rasterizer, which uses it
+	OcclusionRasterizer occlusionRasterizer_;
+	uint32_t pvsCell_ = Pvs::kNoCell; // the camera's, as of the last frame
+	BindStats bindStats_;
+	std::chrono::steady_clock::time_point lastCullingStatsTime_ =
+			std::chrono::steady_clock::now();
+
+	// every texture shares one sampler
 	VkSampler textureSampler_;
 
 	// depth buffering
 	VkImage depthImage_;
 	VkDeviceMemory depthImageMemory_;
 	VkImageView depthImageView_;
+
+	// the depth pyramid, only with GPU culling
+	VkImage depthPyramidImage_ = VK_NULL_HANDLE;
+	VkDeviceMemory depthPyramidMemory_ = VK_NULL_HANDLE;
+	VkImageView depthPyramidView_ = VK_NULL_HANDLE; // every level
+	std::vector<VkImageView> depthPyramidLevelViews_;
+	uint32_t depthPyramidWidth_ = 0;
+	uint32_t depthPyramidHeight_ = 0;
+	uint32_t depthPyramidLevelCount_ = 0;
+	bool depthPyramidNeedsTransition_ = false;
+	VkSampler depthPyramidSampler_ = VK_NULL_HANDLE;
+	VkDescriptorPool depthReduceDescriptorPool_ = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> depthReduceDescriptorSets_; // one per level
 };
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "model.h"
+#include "pvs.h"
+#include "shader_permutation.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+using MeshId = uint32_t;
+using MaterialId = uint32_t;
+using RenderableId = uint32_t;
+
+// what a renderable looks like, as opposed to what shape it is
+struct Material {
+	Texture* texture = nullptr;
+	ShaderPermutation shaderPermutation = kDefaultShaderPermutation;
+};
+
+// The registry of everything there is to draw.  Meshes and materials are
+// shared, and a renderable is one placement of a mesh with a material.
+// Renderables are stored as a structure of arrays, indexed by RenderableId,
+// so passes like culling and sorting walk contiguous arrays of just the
+// fields they need instead of striding over whole objects.
+// The renderer reads the renderables every frame, so adding or moving them
+// shows up on the next draw.  Meshes and materials are only uploaded when the
+// renderer is created, so it locks them, and adding any after that throws.
+// Spatial queries go through a BVH over the renderables' bounds, which is
+// brought up to date on demand by updateBvh().
+// A scene that never moves can also have a precomputed PVS (pvs.h), which is
+// only kept as long as nothing changes.
+struct Scene {
+	MeshId addMesh(Model* model) {
+		if (meshesAndMaterialsLocked_) {
+			throw std::runtime_error("meshes can't be added once the renderer has been created");
+		}
+
+		meshes_.push_back(model);
+
+		return static_cast<MeshId>(meshes_.size() - 1);
+	}
+
+	MaterialId addMaterial(const Material& material) {
+		if (meshesAndMaterialsLocked_) {
+			throw std::runtime_error("materials can't be added once the renderer has been created");
+		}
+
+		if (material.texture == nullptr) {
+			throw std::runtime_error("materials need a texture");
+		}
+
+		materials_.push_back(material);
+
+		return static_cast<MaterialId>(materials_.size() - 1);
+	}
+
+	RenderableId addRenderable(
+			MeshId meshId, MaterialId materialId, const glm::mat4& transform) {
+		if (meshId >= meshes_.size() || materialId >= materials_.size()) {
+			throw std::runtime_error("renderable refers to an unknown mesh or material");
+		}
+
+		RenderableId id = static_cast<RenderableId>(transforms_.size());
+
+		transforms_.push_back(transform);
+		boundsCenterX_.push_back(0.0f);
+		boundsCenterY_.push_back(0.0f);
+		boundsCenterZ_.push_back(0.0f);
+		boundsRadius_.push_back(0.0f);
+		meshIds_.push_back(meshId);
+		materialIds_.push_back(materialId);
+		occluders_.push_back(0);
+
+		this->updateBounds(id);
+		revision_++;
+		pvs_ = Pvs{};
+
+		return id;
+	}
+
+	void setTransform(RenderableId id, const glm::mat4& transform) {
+		transforms_[id] = transform;
+		this->updateBounds(id);
+		revision_++;
+		pvs_ = Pvs{};
+
+		// past a point it's cheaper to refit everything anyways
+		if (movedRenderables_.size() < transforms_.size()) {
+			movedRenderables_.push_back(id);
+		}
+	}
+
+	// occluders are rasterized by the CPU culling path's software occlusion
+	// test, so only tag a few big, solid renderables
+	void setOccluder(RenderableId id, bool isOccluder) {
+		occluders_[id] = isOccluder ? 1 : 0;
+		pvs_ = Pvs{};
+	}
+
+	// called by the renderer before it uploads the meshes and textures
+	void lockMeshesAndMaterials() {
+		meshesAndMaterialsLocked_ = true;
+	}
+
+	size_t getRenderableCount() const {
+		return transforms_.size();
+	}
+
+	// changes whenever a renderable is added or moved, so copies of the scene
+	// on the GPU only need updating when it does
+	uint64_t getRevision() const {
+		return revision_;
+	}
+
+	// rebuilds the BVH when renderables have been added since the last call,
+	// and otherwise refits it to the ones that moved
+	// refitting doesn't change the tree's shape, so it's also rebuilt once
+	// there have been as many moves since the last build as there are
+	// renderables, by which point queries have usually slowed down
+	// workerPool can be null, to build on the calling thread
+	void updateBvh(WorkerPool* workerPool) {
+		size_t renderableCount = this->getRenderableCount();
+		movesSinceBuild_ += movedRenderables_.size();
+
+		if (
+				bvh_.getItemCount() != renderableCount ||
+				movesSinceBuild_ >= std::max<size_t>(renderableCount, 1)) {
+			bvh_.build(this->getRenderableBoxes(), workerPool);
+			movesSinceBuild_ = 0;
+		} else if (movedRenderables_.empty()) {
+			return;
+		} else if (movedRenderables_.size() >= renderableCount / 4) {
+			bvh_.refit(this->getRenderableBoxes());
+		} else {
+			for (RenderableId id : movedRenderables_) {
+				bvh_.updateItem(id, this->getRenderableBox(id));
+			}
+		}
+
+		movedRenderables_.clear();
+	}
+
+	// the nearest renderable whose bounds the ray hits, as of the last
+	// updateBvh()
+	std::optional<BvhRayHit> pickRenderable(
+			const glm::vec3& origin, const glm::vec3& direction) const {
+		return bvh_.raycast(origin, direction);
+	}
+
+	// appends every renderable whose bounds come within radius of center, as of
+	// the last updateBvh()
+	void findRenderablesNear(
+			const glm::vec3& center,
+			float radius,
+			std::vector<RenderableId>& renderables) const {
+		bvh_.findItemsInSphere(center, radius, renderables);
+	}
+
+	// the BVH's boxes are around the bounding spheres
+	Aabb getRenderableBox(RenderableId id) const {
+		return Aabb::fromSphere(
+				glm::vec3(boundsCenterX_[id], boundsCenterY_[id], boundsCenterZ_[id]),
+				boundsRadius_[id]);
+	}
+
+	// everything a PVS depends on: which meshes are where, and what hides
+	// things
+	// transforms are hashed rather than bounds, since they're exactly what was
+	// passed in, while bounds are computed and could round differently in
+	// pvs_builder than in the renderer
+	uint64_t hashForPvs() const {
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+
+		auto add = [&](const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+			for (size_t i = 0; i < size; i++) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+
+		uint64_t renderableCount = transforms_.size();
+		add(&renderableCount, sizeof(renderableCount));
+		add(transforms_.data(), transforms_.size() * sizeof(glm::mat4));
+		add(meshIds_.data(), meshIds_.size() * sizeof(MeshId));
+		add(occluders_.data(), occluders_.size());
+
+		for (const Model* mesh : meshes_) {
+			uint64_t indexCount = mesh->indices.size();
+			add(&indexCount, sizeof(indexCount));
+		}
+
+		return hash;
+	}
+
+	// false, leaving the scene without one, if the PVS was built from a
+	// different scene
+	bool setPvs(Pvs pvs) {
+		if (
+				pvs.getSceneHash() != this->hashForPvs() ||
+				pvs.getClusterCount() != transforms_.size()) {
+			pvs_ = Pvs{};
+			return false;
+		}
+
+		pvs_ = std::move(pvs);
+
+		return true;
+	}
+
+	// null when there isn't one, or the scene has changed since it was set
+	const Pvs* getPvs() const {
+		return pvs_.isEmpty() ? nullptr : &pvs_;
+	}
+
+	std::vector<Aabb> getRenderableBoxes() const {
+		std::vector<Aabb> boxes(transforms_.size());
+
+		for (RenderableId id = 0; id < boxes.size(); id++) {
+			boxes[id] = this->getRenderableBox(id);
+		}
+
+		return boxes;
+	}
+
+	// meshes and materials, indexed by id
+	std::vector<Model*> meshes_;
+	std::vector<Material> materials_;
+
+	// renderables
+	std::vector<glm::mat4> transforms_;
+	// world space bounding spheres, kept up to date with the transforms
+	std::vector<float> boundsCenterX_;
+	std::vector<float> boundsCenterY_;
+	std::vector<float> boundsCenterZ_;
+	std::vector<float> boundsRadius_;
+	std::vector<MeshId> meshIds_;
+	std::vector<MaterialId> materialIds_;
+	std::vector<uint8_t> occluders_; // 1 if tagged with setOccluder()
+
+	Bvh bvh_; // over the renderables, see updateBvh()
+
+ private:
+	uint64_t revision_ = 0;
+	bool meshesAndMaterialsLocked_ = false;
+	std::vector<RenderableId> movedRenderables_; // since the last updateBvh()
+	size_t movesSinceBuild_ = 0; // counted by updateBvh()
+	Pvs pvs_; // empty unless setPvs() was given one that matches
+
+	// moves the mesh's sphere into world space
+	// the radius is scaled by the largest axis scale, so it stays conservative
+	// under non-uniform scaling
+	void updateBounds(RenderableId id) {
+		const glm::mat4& transform = transforms_[id];
+		const MeshBounds& meshBounds = meshes_[meshIds_[id]]->bounds;
+
+		glm::vec3 center = glm::vec3(transform * glm::vec4(meshBounds.center, 1.0f));
+		float scale = std::max({
+			glm::length(glm::vec3(transform[0])),
+			glm::length(glm::vec3(transform[1])),
+			glm::length(glm::vec3(transform[2]))
+		});
+
+		boundsCenterX_[id] = center.x;
+		boundsCenterY_[id] = center.y;
+		boundsCenterZ_[id] = center.z;
+		boundsRadius_[id] = meshBounds.radius * scale;
+	}
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "shader_loader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Precompiled shaders are packed into a single bundle by shader_compiler, so
+// loading every shader is one file read.  The layout is:
+//
+//   uint32 magic, uint32 version, uint32 entry count
+//   per entry:
+//     uint32 name length, name bytes (no terminator)
+//     uint64 source hash (covers includes and compile options)
+//     uint32 SPIR-V size in bytes, SPIR-V
+//
+// The source hash lets shader_compiler skip shaders that haven't changed.
+const char* const kShaderBundleFilename = "shaders/shaders.bundle";
+
+const uint32_t kShaderBundleMagic = 0x42534850; // "PHSB"
+const uint32_t kShaderBundleVersion = 1;
+
+struct ShaderBundleEntry {
+	std::string name; // file name relative to the shader directory
+	uint64_t sourceHash;
+	std::vector<char> spirV;
+};
+
+struct ShaderBundle {
+	static ShaderBundle load(const std::string& filename) {
+		std::vector<char> data = readFile(filename);
+		size_t position = 0;
+
+		auto read = [&](void* destination, size_t size) {
+			if (position + size > data.size()) {
+				throw std::runtime_error("shader bundle " + filename + " is truncated");
+			}
+
+			memcpy(destination, data.data() + position, size);
+			position += size;
+		};
+
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		uint32_t entryCount = 0;
+		read(&magic, sizeof(magic));
+		read(&version, sizeof(version));
+		read(&entryCount, sizeof(entryCount));
+
+		if (magic != kShaderBundleMagic || version != kShaderBundleVersion) {
+			throw std::runtime_error(
+					filename + " isn't a shader bundle, or is from an older version");
+		}
+
+		ShaderBundle bundle;
+		bundle.entries_.resize(entryCount);
+
+		for (ShaderBundleEntry& entry : bundle.entries_) {
+			uint32_t nameLength = 0;
+			read(&nameLength, sizeof(nameLength));
+			entry.name.resize(nameLength);
+			read(&entry.name[0], nameLength);
+
+			read(&entry.sourceHash, sizeof(entry.sourceHash));
+
+			uint32_t spirVSize = 0;
+			read(&spirVSize, sizeof(spirVSize));
+			entry.spirV.resize(spirVSize);
+			read(entry.spirV.data(), spirVSize);
+		}
+
+		return bundle;
+	}
+
+	void save(const std::string& filename) const {
+		// write to a temporary file and move it into place, so the renderer's
+		// shader watcher never sees a half-written bundle
+		std::string tempFilename = filename + ".tmp";
+		std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open " + tempFilename + " for writing");
+		}
+
+		auto write = [&](const void* source, size_t size) {
+			file.write(reinterpret_cast<const char*>(source), size);
+		};
+
+		uint32_t entryCount = static_cast<uint32_t>(entries_.size());
+		write(&kShaderBundleMagic, sizeof(kShaderBundleMagic));
+		write(&kShaderBundleVersion, sizeof(kShaderBundleVersion));
+		write(&entryCount, sizeof(entryCount));
+
+		for (const ShaderBundleEntry& entry : entries_) {
+			uint32_t nameLength = static_cast<uint32_t>(entry.name.size());
+			write(&nameLength, sizeof(nameLength));
+			write(entry.name.data(), nameLength);
+
+			write(&entry.sourceHash, sizeof(entry.sourceHash));
+
+			uint32_t spirVSize = static_cast<uint32_t>(entry.spirV.size());
+			write(&spirVSize, sizeof(spirVSize));
+			write(entry.spirV.data(), spirVSize);
+		}
+
+		file.close();
+
+		if (file.fail()) {
+			std::remove(tempFilename.c_str());
+			throw std::runtime_error("failed to write shader bundle " + filename);
+		}
+
+		// rename() won't replace an existing file on Windows
+		std::remove(filename.c_str());
+
+		if (std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+			throw std::runtime_error("failed to move shader bundle into place");
+		}
+	}
+
+	const ShaderBundleEntry* find(const std::string& name) const {
+		for (const ShaderBundleEntry& entry : entries_) {
+			if (entry.name == name) {
+				return &entry;
+			}
+		}
+
+		return nullptr;
+	}
+
+	const std::vector<char>& getSpirV(const std::string& name) const {
+		const ShaderBundleEntry* entry = this->find(name);
+
+		if (entry == nullptr) {
+			throw std::runtime_error(
+					"shader " + name + " not found in bundle, try running make shaders");
+		}
+
+		return entry->spirV;
+	}
+
+	std::vector<ShaderBundleEntry> entries_;
+};
@@ -1,85 +1,196 @@
 #define _ALLOW_ITERATOR_DEBUG_LEVEL_MISMATCH
 
+// the tool always uses libshaderc, regardless of what the renderer does
+#define PHALANX_DYNAMIC_SHADER_COMPILATION 1
+
+#include "shader_bundle.h"
+#include "shader_loader.h"
+
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <cstring>
-#include <fstream>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <shaderc/shaderc.hpp>
 
 
-// this was my testbench for using libshaderc to compile shaders within my
-// program, instead of doing it beforehand
+// this started out as my testbench for using libshaderc to compile shaders
+// within my program, and is now the offline shader build:
+//
+//   shader_compiler <shader directory> <output bundle> [-j threads]
+//
+// every shader stage in the directory is compiled (in parallel) with
+// optimization enabled and packed into a single bundle.  Shaders whose
+// source, includes and options hash the same as in the existing bundle are
+// reused instead of recompiled.
+
+// bump this whenever the options passed to compileShader() below change
+const char* const kBundleCompileOptionsKey = "glsl;main;opt=performance;v1";
+
+const std::map<std::string, shaderc_shader_kind> kShaderKindsByExtension = {
+	{".vert", shaderc_glsl_vertex_shader},
+	{".frag", shaderc_glsl_fragment_shader},
+	{".comp", shaderc_glsl_compute_shader},
+	{".geom", shaderc_glsl_geometry_shader},
+	{".tesc", shaderc_glsl_tess_control_shader},
+	{".tese", shaderc_glsl_tess_evaluation_shader},
+};
+
+struct ShaderJob {
+	std::string name; // relative to the shader directory, used as the bundle key
+	std::string path;
+	shaderc_shader_kind kind;
+};
+
+std::vector<ShaderJob> findShaders(const std::string& shaderDirectory) {
+	std::vector<ShaderJob> jobs;
+
+	for (const auto& file : std::filesystem::directory_iterator(shaderDirectory)) {
+		if (!file.is_regular_file()) {
+			continue;
+		}
 
+		// anything else, like .glsl, is assumed to be an include
+		auto kind = kShaderKindsByExtension.find(file.path().extension().string());
 
-// file loading helper, for shaders
-static std::vector<char> readFile(const std::string& filename) {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+		if (kind == kShaderKindsByExtension.end()) {
+			continue;
+		}
 
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file");
+		ShaderJob job;
+		job.name = file.path().filename().generic_string();
+		job.path = normalizeShaderPath(file.path().generic_string());
+		job.kind = kind->second;
+		jobs.push_back(job);
 	}
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
+	// keep the bundle contents in a stable order
+	std::sort(jobs.begin(), jobs.end(), [](const ShaderJob& a, const ShaderJob& b) {
+		return a.name < b.name;
+	});
 
-	return buffer;
+	return jobs;
 }
 
 
 
-int main() {
-	std::cout << "here we go\n";
-	
-	std::string shader_file_name = "shader.frag";
+int main(int argc, char** argv) {
+	if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "-j")) {
+		std::cerr << "usage: " << argv[0] <<
+				" <shader directory> <output bundle> [-j threads]\n";
+		return EXIT_FAILURE;
+	}
+
+	std::string shaderDirectory = argv[1];
+	std::string bundleFilename = argv[2];
+
+	unsigned int threadCount = argc == 5 ?
+			static_cast<unsigned int>(std::atoi(argv[4])) :
+			std::thread::hardware_concurrency();
+	threadCount = std::max(threadCount, 1u);
+
+	std::vector<ShaderJob> jobs;
+
+	try {
+		jobs = findShaders(shaderDirectory);
+	} catch (const std::exception& e) {
+		std::cerr << "couldn't read shader directory: " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the previous bundle, for incremental rebuilds
+	ShaderBundle previousBundle;
 
-	std::vector<char> shader_glsl = readFile(shader_file_name);
-	if (shader_glsl.empty()) {
-		std::cout << "empty file!\n";
+	try {
+		previousBundle = ShaderBundle::load(bundleFilename);
+	} catch (const std::exception&) {
+		std::cout << "no usable bundle at " << bundleFilename <<
+				", compiling everything\n";
 	}
 
-	shaderc::CompileOptions compile_options;
-	compile_options.SetSourceLanguage(shaderc_source_language_glsl);
-
-	shaderc::Compiler compiler;
-	const auto compilation_result = compiler.CompileGlslToSpv(
-			shader_glsl.data(),
-			shader_glsl.size(),
-			shaderc_glsl_default_fragment_shader,
-			shader_file_name.c_str(),
-			"main",
-			compile_options);
-
-	if (compilation_result.GetCompilationStatus() == shaderc_compilation_status_success) {
-		std::cout << "it worked!!!\n";
-
-		std::string output_file_name = "test.spv";
-		std::ofstream output_file_stream;
-		output_file_stream.open(output_file_name, std::ios_base::binary);
-		
-		if (output_file_stream.fail()) {
-			std::cerr << "failed to open file " << output_file_name << std::endl;
-			return 1;
+	std::vector<ShaderBundleEntry> entries(jobs.size());
+	std::atomic<size_t> nextJob{0};
+	std::atomic<uint32_t> compiledCount{0};
+	std::atomic<uint32_t> failedCount{0};
+	std::mutex logMutex;
+
+	auto worker = [&]() {
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+			const ShaderJob& job = jobs[i];
+			ShaderBundleEntry& entry = entries[i];
+			entry.name = job.name;
+
+			try {
+				std::vector<char> source = readFile(job.path);
+				entry.sourceHash = hashShaderCompile(
+						job.path, source, job.kind, kBundleCompileOptionsKey);
+
+				const ShaderBundleEntry* previous = previousBundle.find(job.name);
+
+				if (previous != nullptr && previous->sourceHash == entry.sourceHash) {
+					entry.spirV = previous->spirV;
+					continue;
+				}
+
+				entry.spirV = compileShader(
+						job.path, source, job.kind, shaderc_optimization_level_performance);
+				compiledCount++;
+
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cout << "compiled " << job.path << std::endl;
+			} catch (const std::exception& e) {
+				failedCount++;
+
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cerr << job.path << ": " << e.what() << std::endl;
+			}
 		}
+	};
+
+	std::vector<std::thread> threads;
 
-		std::vector<char> compilation_output(
-				reinterpret_cast<const char*>(compilation_result.cbegin()),
-				reinterpret_cast<const char*>(compilation_result.cend()));
+	for (unsigned int i = 0; i < std::min<size_t>(threadCount, jobs.size()); i++) {
+		threads.emplace_back(worker);
+	}
 
-		output_file_stream.write(compilation_output.data(), compilation_output.size());
-		output_file_stream.close();
-	} else {
-		std::cout << "it didn't work :(\n";
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
 
-		std::cerr << compilation_result.GetErrorMessage() << std::endl;
+	if (failedCount > 0) {
+		// leave the old bundle alone, so the renderer keeps working
+		std::cerr << failedCount << " shader(s) failed to compile\n";
+		return EXIT_FAILURE;
 	}
 
-	std::cout << "we're done!!!\n";
-	return 0;
+	bool removedShaders = previousBundle.entries_.size() != entries.size();
+
+	if (compiledCount == 0 && !removedShaders) {
+		// don't touch the file, or the renderer would reload for nothing
+		std::cout << bundleFilename << " is up to date\n";
+		return EXIT_SUCCESS;
+	}
+
+	ShaderBundle bundle;
+	bundle.entries_ = std::move(entries);
+
+	try {
+		bundle.save(bundleFilename);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "wrote " << bundle.entries_.size() << " shader(s) to " <<
+			bundleFilename << " (" << compiledCount << " compiled, " <<
+			bundle.entries_.size() - compiledCount << " up to date)\n";
+
+	return EXIT_SUCCESS;
 }
@@ -4,10 +4,18 @@
 #include <shaderc/shaderc.hpp>
 #endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 1
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -30,35 +38,241 @@ static std::vector<char> readFile(const std::string& filename) {
 }
 
 #if PHALANX_DYNAMIC_SHADER_COMPILATION == 1
-// we compile shaders on the fly, before rendering begins
-std::vector<char> loadShader(
-	const std::string& shaderFileName,
-	shaderc_shader_kind shaderKind) {
-	std::vector<char> shaderGlsl = readFile(shaderFileName);
+// compiled SPIR-V is cached on disk and in memory, keyed by a hash of
+// everything that affects the output: the source, the contents of every file
+// it includes, the shader kind, and the compile options
+const char* const kShaderCacheDirectory = "shaders/cache";
 
-	if (shaderGlsl.empty()) {
-		throw std::runtime_error("empty shader file provided");
+// bump this whenever makeCompileOptions() changes, so stale SPIR-V compiled
+// with the old options isn't picked up from the disk cache
+// runtime compiles skip optimization, since they need to be quick
+const char* const kShaderCompileOptionsKey = "glsl;main;opt=zero;v1";
+
+const uint32_t kSpirVMagicNumber = 0x07230203;
+
+// 64-bit FNV-1a, which is plenty for telling shader sources apart
+uint64_t hashBytes(uint64_t hash, const char* data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+uint64_t hashString(uint64_t hash, const std::string& str) {
+	// include the terminator so "ab" + "c" and "a" + "bc" hash differently
+	return hashBytes(hash, str.c_str(), str.size() + 1);
+}
+
+const uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+// "shaders/../shaders/a.glsl" and "shaders/a.glsl" are the same file
+std::string normalizeShaderPath(const std::string& fileName) {
+	return std::filesystem::path(fileName).lexically_normal().generic_string();
+}
+
+std::string getDirectory(const std::string& fileName) {
+	size_t lastSlash = fileName.find_last_of("/\\");
+
+	return lastSlash == std::string::npos ? "" : fileName.substr(0, lastSlash + 1);
+}
+
+// resolves #include "file" relative to the including file, which is how
+// GL_GOOGLE_include_directive works with glslc
+struct ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+	struct IncludeData {
+		std::string sourceName;
+		std::vector<char> content;
+	};
+
+	shaderc_include_result* GetInclude(
+			const char* requestedSource,
+			shaderc_include_type type,
+			const char* requestingSource,
+			size_t includeDepth) override {
+		auto includeData = new IncludeData();
+		includeData->sourceName = getDirectory(requestingSource) + requestedSource;
+
+		auto result = new shaderc_include_result();
+
+		try {
+			includeData->content = readFile(includeData->sourceName);
+			result->source_name = includeData->sourceName.c_str();
+			result->source_name_length = includeData->sourceName.size();
+		} catch (const std::exception&) {
+			// an empty source name tells shaderc the include failed, and the
+			// content is used as the error message
+			std::string error = "couldn't open " + includeData->sourceName;
+			includeData->content.assign(error.begin(), error.end());
+			result->source_name = "";
+			result->source_name_length = 0;
+		}
+
+		result->content = includeData->content.data();
+		result->content_length = includeData->content.size();
+		result->user_data = includeData;
+
+		return result;
+	}
+
+	void ReleaseInclude(shaderc_include_result* result) override {
+		delete static_cast<IncludeData*>(result->user_data);
+		delete result;
 	}
+};
 
+shaderc::CompileOptions makeCompileOptions(
+		shaderc_optimization_level optimizationLevel) {
 	shaderc::CompileOptions compileOptions;
 	compileOptions.SetSourceLanguage(shaderc_source_language_glsl);
+	compileOptions.SetOptimizationLevel(optimizationLevel);
+	compileOptions.SetIncluder(std::make_unique<ShaderIncluder>());
+
+	return compileOptions;
+}
+
+// hashes a file and, recursively, everything it #includes
+// this is a plain text scan rather than a full preprocess, so an include
+// inside an #if 0 block still counts, which at worst causes an extra recompile
+uint64_t hashShaderSource(
+		uint64_t hash,
+		const std::string& fileName,
+		const std::vector<char>& source,
+		std::set<std::string>& visitedFiles) {
+	if (!visitedFiles.insert(normalizeShaderPath(fileName)).second) {
+		return hash; // include guards or a cycle
+	}
+
+	hash = hashString(hash, fileName);
+	hash = hashBytes(hash, source.data(), source.size());
+
+	std::string text(source.begin(), source.end());
+	size_t position = 0;
+
+	while ((position = text.find("#include", position)) != std::string::npos) {
+		size_t lineEnd = text.find('\n', position);
+		size_t openQuote = text.find('"', position);
+		size_t closeQuote =
+				openQuote == std::string::npos ? openQuote : text.find('"', openQuote + 1);
+		position += 1;
+
+		if (closeQuote == std::string::npos || closeQuote > lineEnd) {
+			continue; // <system> style includes aren't supported
+		}
+
+		std::string includeName = getDirectory(fileName) +
+				text.substr(openQuote + 1, closeQuote - openQuote - 1);
+
+		try {
+			std::vector<char> includeSource = readFile(includeName);
+			hash = hashShaderSource(hash, includeName, includeSource, visitedFiles);
+		} catch (const std::exception&) {
+			// let the compiler report the missing file
+			hash = hashString(hash, includeName);
+		}
+	}
+
+	return hash;
+}
+
+// every file a shader is built from, including itself, so the shader watcher
+// knows which pipelines an edit affects
+std::set<std::string> getShaderDependencies(const std::string& shaderFileName) {
+	std::set<std::string> dependencies;
+
+	try {
+		hashShaderSource(
+				kHashSeed, shaderFileName, readFile(shaderFileName), dependencies);
+	} catch (const std::exception&) {
+		// still watch the file, so the shader gets built once it shows up
+		dependencies.insert(normalizeShaderPath(shaderFileName));
+	}
+
+	return dependencies;
+}
+
+// the cache key for compiling a shader with a particular set of options
+uint64_t hashShaderCompile(
+		const std::string& shaderFileName,
+		const std::vector<char>& shaderGlsl,
+		shaderc_shader_kind shaderKind,
+		const std::string& compileOptionsKey) {
+	std::set<std::string> visitedFiles;
+	uint64_t hash = hashShaderSource(
+			kHashSeed, shaderFileName, shaderGlsl, visitedFiles);
+	hash = hashString(hash, compileOptionsKey);
+
+	return hashBytes(
+			hash, reinterpret_cast<const char*>(&shaderKind), sizeof(shaderKind));
+}
 
+std::string getShaderCacheFileName(uint64_t hash) {
+	char hashString[17];
+	snprintf(hashString, sizeof(hashString), "%016llx", (unsigned long long)hash);
+
+	return std::string(kShaderCacheDirectory) + "/" + hashString + ".spv";
+}
+
+bool isValidSpirV(const std::vector<char>& code) {
+	if (code.size() < sizeof(uint32_t) || code.size() % sizeof(uint32_t) != 0) {
+		return false;
+	}
+
+	uint32_t magic;
+	memcpy(&magic, code.data(), sizeof(magic));
+
+	return magic == kSpirVMagicNumber;
+}
+
+void writeShaderCacheFile(const std::string& fileName, const std::vector<char>& code) {
+	std::error_code error;
+	std::filesystem::create_directories(kShaderCacheDirectory, error);
+
+	// write to a temporary file and move it into place, so a half-written file
+	// is never picked up
+	std::string tempFileName = fileName + ".tmp";
+	std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+		std::cerr << "failed to write shader cache file " << fileName << std::endl;
+		return;
+	}
+
+	file.write(code.data(), code.size());
+	file.close();
+
+	std::filesystem::rename(tempFileName, fileName, error);
+
+	if (error) {
+		std::filesystem::remove(tempFileName, error);
+	}
+}
+
+std::vector<char> compileShader(
+		const std::string& shaderFileName,
+		const std::vector<char>& shaderGlsl,
+		shaderc_shader_kind shaderKind,
+		shaderc_optimization_level optimizationLevel = shaderc_optimization_level_zero) {
 	const char* entryPointName = "main";
 
-	shaderc::Compiler compiler;
+	// the compiler is expensive to create, so share one for the whole program
+	// compiling only reads the compiler, so this is safe from multiple threads
+	static shaderc::Compiler compiler;
 	const auto compilationResult = compiler.CompileGlslToSpv(
 		shaderGlsl.data(),
 		shaderGlsl.size(),
 		shaderKind,
 		shaderFileName.c_str(),
 		entryPointName,
-		compileOptions);
+		makeCompileOptions(optimizationLevel));
 
 	if (
 		compilationResult.GetCompilationStatus() !=
 		shaderc_compilation_status_success) {
-		std::cerr << "shader compilation error:\n";
-		std::cerr << compilationResult.GetErrorMessage() << std::endl;
+		// print in one go, so errors from different threads don't interleave
+		std::cerr << "shader compilation error:\n" +
+				compilationResult.GetErrorMessage() << std::endl;
 
 		throw std::runtime_error("failed to compile shader");
 	}
@@ -70,6 +284,69 @@ std::vector<char> loadShader(
 	return compilationOutput;
 }
 
+// we compile shaders on the fly, before rendering begins, unless an identical
+// compile has been done before
+std::vector<char> loadShader(
+	const std::string& shaderFileName,
+	shaderc_shader_kind shaderKind) {
+	// shaders can be loaded from the pipeline build thread while the main thread
+	// is doing the same, so the memory cache needs a lock
+	// it only keeps the latest compile of each file, so hot reloading doesn't
+	// pile up SPIR-V for every edit; older ones are still in the disk cache
+	struct MemoryCacheEntry {
+		uint64_t hash;
+		std::vector<char> code;
+	};
+
+	static std::mutex memoryCacheMutex;
+	static std::unordered_map<std::string, MemoryCacheEntry> memoryCache;
+
+	std::vector<char> shaderGlsl = readFile(shaderFileName);
+
+	if (shaderGlsl.empty()) {
+		throw std::runtime_error("empty shader file provided");
+	}
+
+	uint64_t hash = hashShaderCompile(
+			shaderFileName, shaderGlsl, shaderKind, kShaderCompileOptionsKey);
+
+	{
+		std::lock_guard<std::mutex> lock(memoryCacheMutex);
+		auto cached = memoryCache.find(shaderFileName);
+
+		if (cached != memoryCache.end() && cached->second.hash == hash) {
+			return cached->second.code;
+		}
+	}
+
+	std::string cacheFileName = getShaderCacheFileName(hash);
+
+	try {
+		std::vector<char> cachedCode = readFile(cacheFileName);
+
+		if (isValidSpirV(cachedCode)) {
+			std::cout << "loaded " << shaderFileName << " from shader cache\n";
+			std::lock_guard<std::mutex> lock(memoryCacheMutex);
+			memoryCache[shaderFileName] = { hash, cachedCode };
+			return cachedCode;
+		}
+	} catch (const std::exception&) {
+		// not cached yet
+	}
+
+	std::cout << "compiling " << shaderFileName << std::endl;
+
+	std::vector<char> compilationOutput =
+			compileShader(shaderFileName, shaderGlsl, shaderKind);
+
+	writeShaderCacheFile(cacheFileName, compilationOutput);
+
+	std::lock_guard<std::mutex> lock(memoryCacheMutex);
+	memoryCache[shaderFileName] = { hash, compilationOutput };
+
+	return compilationOutput;
+}
+
 std::vector<char> loadVertexShader(const std::string& shaderFileName) {
 	return loadShader(shaderFileName, shaderc_glsl_default_vertex_shader);
 }
@@ -77,4 +354,8 @@ std::vector<char> loadVertexShader(const std::string& shaderFileName) {
 std::vector<char> loadFragmentShader(const std::string& shaderFileName) {
 	return loadShader(shaderFileName, shaderc_glsl_default_fragment_shader);
 }
+
+std::vector<char> loadComputeShader(const std::string& shaderFileName) {
+	return loadShader(shaderFileName, shaderc_glsl_default_compute_shader);
+}
 #endif // PHALANX_DYNAMIC_SHADER_COMPILATION == 1
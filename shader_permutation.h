@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+
+// Optional shader features are specialization constants instead of runtime
+// branches or hand-edited shaders.  The SPIR-V is compiled once, and the
+// driver folds the constants in when each pipeline variant is created, so a
+// disabled feature costs nothing.  A feature's bit index is its constant_id
+// in the shaders.
+enum ShaderFeature : uint32_t {
+	kShaderFeatureTexture = 1 << 0, // sample the texture
+	kShaderFeatureVertexColor = 1 << 1, // multiply by the per-vertex color
+	kShaderFeaturePositionTint = 1 << 2, // multiply by a screen position gradient
+};
+
+const uint32_t kShaderFeatureCount = 3;
+
+// the set of enabled features, which identifies a pipeline variant
+using ShaderPermutation = uint32_t;
+
+const ShaderPermutation kDefaultShaderPermutation = kShaderFeatureTexture;
+
+inline std::string describeShaderPermutation(ShaderPermutation permutation) {
+	const char* featureNames[kShaderFeatureCount] = {
+		"texture", "vertex color", "position tint"
+	};
+
+	std::string description;
+
+	for (uint32_t i = 0; i < kShaderFeatureCount; i++) {
+		if (permutation & (1u << i)) {
+			description += description.empty() ? "" : " + ";
+			description += featureNames[i];
+		}
+	}
+
+	return description.empty() ? "no features" : description;
+}
+
+// the texture table's size comes after the feature constants, since it
+// depends on the device's descriptor limits
+const uint32_t kTextureTableSizeConstantId = kShaderFeatureCount;
+const uint32_t kSpecializationConstantCount = kShaderFeatureCount + 1;
+
+// the specialization constants for one permutation
+// info points into the struct itself, so it can't be copied or moved, and it
+// has to stay alive until the pipeline is created
+struct ShaderSpecialization {
+	ShaderSpecialization(ShaderPermutation permutation, uint32_t textureTableSize) {
+		for (uint32_t i = 0; i < kShaderFeatureCount; i++) {
+			values[i] = (permutation & (1u << i)) ? VK_TRUE : VK_FALSE;
+		}
+
+		values[kTextureTableSizeConstantId] = textureTableSize;
+
+		for (uint32_t i = 0; i < kSpecializationConstantCount; i++) {
+			mapEntries[i].constantID = i;
+			mapEntries[i].offset = i * sizeof(uint32_t);
+			mapEntries[i].size = sizeof(uint32_t); // GLSL bools are 32 bits too
+		}
+
+		info.mapEntryCount = kSpecializationConstantCount;
+		info.pMapEntries = mapEntries.data();
+		info.dataSize = sizeof(values);
+		info.pData = values.data();
+	}
+
+	ShaderSpecialization(const ShaderSpecialization&) = delete;
+	ShaderSpecialization& operator=(const ShaderSpecialization&) = delete;
+
+	std::array<uint32_t, kSpecializationConstantCount> values; // VkBool32 for features
+	std::array<VkSpecializationMapEntry, kSpecializationConstantCount> mapEntries;
+	VkSpecializationInfo info{};
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+
+// Watches a directory for shader edits, so pipelines can be rebuilt without
+// pressing R.  This uses inotify, so it only does anything on Linux; elsewhere
+// pollChangedFiles() never returns anything and R is still the way to reload.
+// The watch isn't recursive, which also keeps writes to shaders/cache from
+// showing up here.
+struct ShaderWatcher {
+	ShaderWatcher(const std::string& directory) {
+		this->directory_ = directory;
+
+#ifdef __linux__
+		// non-blocking, since this is polled once a frame
+		inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+		if (inotifyFd_ < 0) {
+			std::cerr << "couldn't initialize inotify, shaders won't be watched\n";
+			return;
+		}
+
+		// editors either write the file in place (IN_CLOSE_WRITE) or write a new
+		// file and rename it over the old one (IN_MOVED_TO)
+		watchDescriptor_ = inotify_add_watch(
+				inotifyFd_,
+				directory.c_str(),
+				IN_CLOSE_WRITE | IN_MOVED_TO);
+
+		if (watchDescriptor_ < 0) {
+			std::cerr << "couldn't watch " << directory << " for shader changes\n";
+			close(inotifyFd_);
+			inotifyFd_ = -1;
+			return;
+		}
+
+		std::cout << "watching " << directory << " for shader changes\n";
+#endif // __linux__
+	}
+
+	~ShaderWatcher() {
+#ifdef __linux__
+		if (inotifyFd_ >= 0) {
+			close(inotifyFd_); // also removes the watch
+		}
+#endif // __linux__
+	}
+
+	// not copyable, since it owns the inotify descriptor
+	ShaderWatcher(const ShaderWatcher&) = delete;
+	ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+	bool isWatching() const {
+		return inotifyFd_ >= 0;
+	}
+
+	// returns each file modified since the last call, once, with the same path
+	// normalization the shader loader uses
+	std::vector<std::string> pollChangedFiles() {
+		std::set<std::string> changedFiles;
+
+#ifdef __linux__
+		if (inotifyFd_ < 0) {
+			return {};
+		}
+
+		// large enough for a batch of events, and aligned for inotify_event
+		alignas(inotify_event) char buffer[4096];
+
+		while (true) {
+			ssize_t length = read(inotifyFd_, buffer, sizeof(buffer));
+
+			if (length <= 0) {
+				// EAGAIN means there's nothing left to read
+				if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+					std::cerr << "failed to read shader watcher events\n";
+				}
+
+				break;
+			}
+
+			for (char* position = buffer; position < buffer + length;) {
+				auto event = reinterpret_cast<inotify_event*>(position);
+				position += sizeof(inotify_event) + event->len;
+
+				if (event->len == 0 || (event->mask & IN_ISDIR)) {
+					continue;
+				}
+
+				changedFiles.insert(
+						std::filesystem::path(directory_ + "/" + event->name)
+								.lexically_normal()
+								.generic_string());
+			}
+		}
+#endif // __linux__
+
+		return std::vector<std::string>(changedFiles.begin(), changedFiles.end());
+	}
+
+	std::string directory_;
+	int inotifyFd_ = -1;
+	int watchDescriptor_ = -1;
+};
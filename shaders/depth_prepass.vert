@@ -0,0 +1,32 @@
+#version 450
+
+// the depth prepass, which draws the scene into the depth buffer only, so the
+// main pass can test with EQUAL and shade each visible pixel exactly once
+// there's no fragment shader, and positions come from the geometry pool's
+// position buffer rather than the full vertices
+
+// the main pass's EQUAL test needs exactly the same depth as this writes, so
+// gl_Position is computed with the same expression as in shader.vert, and
+// invariant on both sides
+invariant gl_Position;
+
+// see shader.vert
+layout(set = 0, binding = 0) uniform FrameUniforms {
+	mat4 viewProjection;
+} frame;
+
+struct InstanceData {
+	mat4 model;
+	uint textureIndex;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+	InstanceData instances[];
+};
+
+layout(location = 0) in vec3 inPosition;
+
+void main() {
+	InstanceData instance = instances[gl_InstanceIndex];
+	gl_Position = frame.viewProjection * (instance.model * vec4(inPosition, 1.0));
+}
@@ -1,24 +1,44 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 1) uniform sampler2D texSampler;
+// feature toggles, set per pipeline (see shader_permutation.h)
+// these are constant when the pipeline is created, so the driver strips out
+// the disabled paths instead of branching at runtime
+layout(constant_id = 0) const bool kUseTexture = true;
+layout(constant_id = 1) const bool kUseVertexColor = false;
+layout(constant_id = 2) const bool kUsePositionTint = false;
+
+// depends on the device's descriptor limits, so it's filled in by the renderer
+layout(constant_id = 3) const uint kTextureTableSize = 1;
+
+// set 1 is the texture table, shared by every draw
+layout(set = 1, binding = 0) uniform sampler2D textures[kTextureTableSize];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+// per-instance, see InstanceData in renderer.h
+layout(location = 2) flat in uint fragTextureIndex;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
+  // the texture's alpha is kept, the other features only tint
+  vec4 color = vec4(1.0);
+
+  // use the supplied texture
+  if (kUseTexture) {
+    color *= texture(textures[fragTextureIndex], fragTexCoord);
+  }
+
   // colors supplied per-vertex
-  // outColor = vec4(fragColor, 1.0);
+  if (kUseVertexColor) {
+    color.rgb *= fragColor;
+  }
 
   // color based on pixel position
-  // outColor = vec4(gl_FragCoord.x / 800, gl_FragCoord.y / 600, 0.0, 1.0);
-
-  // use the supplied texture
-  outColor = texture(texSampler, fragTexCoord);
+  if (kUsePositionTint) {
+    color.rgb *= vec3(gl_FragCoord.x / 800, gl_FragCoord.y / 600, 0.0);
+  }
 
-  // merge texture and some weird color
-  // vec3 pixelColor = vec3(gl_FragCoord.x / 800, gl_FragCoord.y / 600, 0.0);
-  // outColor = vec4(pixelColor * texture(texSampler, fragTexCoord).rgb, 1.0);
+  outColor = color;
 }
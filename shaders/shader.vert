@@ -1,11 +1,20 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
+// set 0 is bound once per frame
+layout(set = 0, binding = 0) uniform FrameUniforms {
+	mat4 viewProjection;
+} frame;
+
+// per-instance data, see InstanceData in renderer.h
+struct InstanceData {
 	mat4 model;
-	mat4 view;
-	mat4 projection;
-} ubo;
+	uint textureIndex;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+	InstanceData instances[];
+};
 
 layout(location = 0) in vec3 inPosition;
 // if inPosition was something like a dvec3 64 bit vector, it would use two
@@ -22,14 +31,25 @@ layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+// the same for every instance of a draw, so it's dynamically uniform in the
+// fragment shader
+layout(location = 2) flat out uint fragTextureIndex;
+
+// must match depth_prepass.vert exactly, for the main pass's EQUAL depth test
+// when the prepass is on
+invariant gl_Position;
 
 void main() {
 	// gl_VertexIndex contains current vertex index
 	// gl_Position is the output clip coordinate??
 
-	gl_Position =
-			ubo.projection * ubo.view * ubo.model * vec4(inPosition, 1.0);
+	// multiply the vector, not the matrices, so this is two matrix-vector
+	// multiplies instead of two extra matrix-matrix ones
+	// gl_InstanceIndex includes the draw's first instance
+	InstanceData instance = instances[gl_InstanceIndex];
+	gl_Position = frame.viewProjection * (instance.model * vec4(inPosition, 1.0));
 
 	fragColor = inColor;
 	fragTexCoord = inTexCoord;
+	fragTextureIndex = instance.textureIndex;
 }
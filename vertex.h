@@ -18,7 +18,7 @@ struct Vertex {
 		VkVertexInputBindingDescription bindingDescription{};
 		bindingDescription.binding = 0; // all vertex data is in one array, so we only have one binding
 		bindingDescription.stride = sizeof(Vertex); // number of bytes between entries
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // move to the next data entry after each vertex (not using instanced rendering)
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // move to the next data entry after each vertex (per-instance data comes from a storage buffer instead, see InstanceData)
 
 		return bindingDescription;
 	}
@@ -52,5 +52,27 @@ struct Vertex {
 
 		return attributeDescriptions;
 	}
+
+	// the depth prepass only needs positions, so the geometry pool keeps them
+	// in a separate, tightly packed stream too, and the prepass reads that
+	// instead of fetching whole vertices
+	static VkVertexInputBindingDescription getPositionBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(glm::vec3);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindingDescription;
+	}
+
+	static VkVertexInputAttributeDescription getPositionAttributeDescription() {
+		VkVertexInputAttributeDescription attributeDescription{};
+		attributeDescription.binding = 0;
+		attributeDescription.location = 0; // same as inPosition in shader.vert
+		attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescription.offset = 0;
+
+		return attributeDescription;
+	}
 };
 
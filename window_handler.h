@@ -65,7 +65,21 @@ struct WindowHandler {
 
 		if (key == GLFW_KEY_R && action == GLFW_PRESS) {
 			std::cout << "pressed the r key\n";
-			self->shouldRecreateSwapChain_ = true;
+			self->shouldReloadShaders_ = true;
+		}
+
+		if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+			self->shouldToggleDepthPrepass_ = true;
+		}
+	}
+
+	static void mouseButtonCallback(
+			GLFWwindow* window, int button, int action, int mods) {
+		auto self = reinterpret_cast<WindowHandler*>(
+				glfwGetWindowUserPointer(window));
+
+		if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+			self->shouldPick_ = true;
 		}
 	}
 
@@ -98,6 +112,7 @@ struct WindowHandler {
 		// capture mouse
 		glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 		glfwSetCursorPosCallback(window_, mousePositionCallback);
+		glfwSetMouseButtonCallback(window_, mouseButtonCallback);
 	}
 
 	GLFWwindow* createWindow() {
@@ -143,12 +158,28 @@ struct WindowHandler {
 		framebufferResized_ = false;
 	}
 
-	bool shouldRecreateSwapchain() {
-		return shouldRecreateSwapChain_;
+	bool shouldReloadShaders() {
+		return shouldReloadShaders_;
+	}
+
+	void resetShouldReloadShaders() {
+		shouldReloadShaders_ = false;
+	}
+
+	bool shouldToggleDepthPrepass() {
+		return shouldToggleDepthPrepass_;
+	}
+
+	void resetShouldToggleDepthPrepass() {
+		shouldToggleDepthPrepass_ = false;
+	}
+
+	bool shouldPick() {
+		return shouldPick_;
 	}
 
-	void resetShouldRecreateSwapchain() {
-		shouldRecreateSwapChain_ = false;
+	void resetShouldPick() {
+		shouldPick_ = false;
 	}
 
 	// Vulkan works with pixels, while GLFW's window size is measured in screen
@@ -187,7 +218,9 @@ struct WindowHandler {
 
 	GLFWwindow* window_;
 	bool framebufferResized_ = false;
-	bool shouldRecreateSwapChain_ = false;
+	bool shouldReloadShaders_ = false;
+	bool shouldToggleDepthPrepass_ = false;
+	bool shouldPick_ = false;
 
 	Input::KeyStates keyStates_;
 	Input::MouseState mouseState_;
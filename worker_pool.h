@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A few threads that sit waiting for work, for splitting per-frame CPU jobs
+// (occlusion rasterization, sorting) into pieces.  run() hands out task
+// indices to the workers and the calling thread until they're all taken, and
+// returns once every task is done, so callers don't need any synchronization
+// of their own beyond writing to separate memory per task.
+struct WorkerPool {
+	~WorkerPool() {
+		this->destroy();
+	}
+
+	// threadCount includes the calling thread, so 1 means no workers at all
+	void init(uint32_t threadCount) {
+		for (uint32_t i = 1; i < threadCount; i++) {
+			workers_.emplace_back([this]() {
+				this->workerLoop();
+			});
+		}
+	}
+
+	void destroy() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+
+		workAvailable_.notify_all();
+
+		for (std::thread& worker : workers_) {
+			worker.join();
+		}
+
+		workers_.clear();
+	}
+
+	uint32_t getThreadCount() const {
+		return static_cast<uint32_t>(workers_.size()) + 1;
+	}
+
+	// calls task(i) for every i from 0 to taskCount - 1, in no particular order
+	// and on any thread
+	void run(uint32_t taskCount, const std::function<void(uint32_t)>& task) {
+		// not worth waking anyone up for
+		if (workers_.empty() || taskCount <= 1) {
+			for (uint32_t i = 0; i < taskCount; i++) {
+				task(i);
+			}
+
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			task_ = &task;
+			taskCount_ = taskCount;
+			nextTask_ = 0;
+			busyWorkerCount_ = static_cast<uint32_t>(workers_.size());
+			generation_++;
+		}
+
+		workAvailable_.notify_all();
+
+		this->runTasks();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		workDone_.wait(lock, [this]() { return busyWorkerCount_ == 0; });
+		task_ = nullptr;
+	}
+
+ private:
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable workAvailable_;
+	std::condition_variable workDone_;
+	uint64_t generation_ = 0; // bumped by every run()
+	uint32_t busyWorkerCount_ = 0;
+	bool stopping_ = false;
+
+	// the current run(), only changed while no worker is busy
+	const std::function<void(uint32_t)>* task_ = nullptr;
+	uint32_t taskCount_ = 0;
+	std::atomic<uint32_t> nextTask_{0};
+
+	void runTasks() {
+		for (
+				uint32_t i = nextTask_.fetch_add(1);
+				i < taskCount_;
+				i = nextTask_.fetch_add(1)) {
+			(*task_)(i);
+		}
+	}
+
+	void workerLoop() {
+		uint64_t finishedGeneration = 0;
+
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				workAvailable_.wait(lock, [&]() {
+					return stopping_ || generation_ != finishedGeneration;
+				});
+
+				if (stopping_) {
+					return;
+				}
+
+				finishedGeneration = generation_;
+			}
+
+			this->runTasks();
+
+			bool lastWorker;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				lastWorker = --busyWorkerCount_ == 0;
+			}
+
+			if (lastWorker) {
+				workDone_.notify_one();
+			}
+		}
+	}
+};